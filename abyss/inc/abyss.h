@@ -3,21 +3,123 @@
 
 #ifdef DEBUG
 
+#include <stddef.h>
 #include <stdint.h>
 
 extern void * abyss_calloc(size_t nitems, size_t size, char * file_name, uint32_t line_number);
 extern void *  abyss_malloc(size_t size, char * file_name, uint32_t line_number);
 extern void *  abyss_realloc(void * ptr, size_t size, char * file_name, uint32_t line_number);
-extern void    abyss_free(void * ptr);
+extern void    abyss_free(void * ptr, char * file_name, uint32_t line_number);
 extern void    abyss_print();
 
+/* allocator under the wrappers, libc by default. ABYSS_BACKEND picks one
+ * at startup: libc, pool, arena or the path of a shared object exporting
+ * `const Abyss_Backend abyss_backend`. switching fails while any block
+ * from the current one is live, logged, past the log or in a cache.
+ * pool and arena tag their blocks, a pointer without the tag (getline,
+ * unwrapped code) is freed or resized by libc */
+typedef struct {
+    const char * name;
+    void * (*alloc)(size_t size);
+    void * (*zalloc)(size_t nitems, size_t size);
+    void * (*resize)(void * ptr, size_t size);
+    void   (*release)(void * ptr);
+} Abyss_Backend;
+
+extern const Abyss_Backend abyss_backend_libc;
+extern const Abyss_Backend abyss_backend_pool;
+extern const Abyss_Backend abyss_backend_arena;
+extern int     abyss_set_backend(const Abyss_Backend * backend);
+extern const Abyss_Backend * abyss_get_backend();
+
+/* called after every successful malloc, calloc and realloc */
+typedef void (*Abyss_Alloc_Hook)(void * ptr, size_t size);
+extern void    abyss_set_alloc_hook(Abyss_Alloc_Hook hook);
+
+/* allocation-forbidden regions, per thread and nestable. any wrapped
+ * malloc, calloc, realloc or free inside one is recorded with its site,
+ * or aborts in strict mode. outside a region the check is one
+ * thread-local load */
+extern _Thread_local uint32_t abyss_no_alloc_depth;
+#define abyss_no_alloc_begin() (abyss_no_alloc_depth++)
+#define abyss_no_alloc_end()   (abyss_no_alloc_depth--)
+extern void    abyss_no_alloc_strict(int strict);
+extern void    abyss_no_alloc_print();
+
+/* per-request memory scopes, one open scope per thread. blocks are tagged
+ * with the scope that allocated them, end returns the request's numbers
+ * and folds them into log2 histograms per request type */
+typedef struct {
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint64_t peak_live_bytes;
+    uint64_t leaked_bytes;      /* still alive when the scope ended */
+} Abyss_Scope_Stats;
+
+extern int     abyss_scope_begin(const char * type);
+extern Abyss_Scope_Stats abyss_scope_end();
+extern void    abyss_scope_print();
+
+/* reserved vs touched bytes per allocation site, for logged blocks of at
+ * least threshold bytes. touched pages are the resident ones (mincore) */
+extern void    abyss_touched_print(size_t threshold);
+
+/* mirrors the log and per-site counters into a MAP_SHARED file (layout in
+ * abyss_persist.h) that outlives a crash, read it with tool/abyss_inspect */
+extern int     abyss_persist(const char * path);
+
+/* opt-in recycling: once a site has made enough same-size allocations it
+ * gets a small per-thread cache of its freed blocks, reused by the next
+ * malloc or calloc there. caches are bounded and trimmed when idle, flush
+ * releases the calling thread's */
+extern void    abyss_recycle(int enable);
+extern void    abyss_recycle_flush();
+extern void    abyss_recycle_print();
+
+/* pre-fork pools: the parent creates the shared region (file backed when
+ * path is set, so abyss_inspect can read it), each worker joins a fixed
+ * slot after fork and publishes its counters and sites there */
+extern int     abyss_workers_create(const char * path, uint32_t workers);
+extern int     abyss_workers_join(uint32_t slot);
+extern void    abyss_workers_print();
+
+/* page-level occupancy of the logged blocks: pages that are only partly
+ * live pin RSS, the sites owning them are ranked by the bytes they pin.
+ * prints a text heat map width pages wide, pgm_path also writes it as a
+ * grayscale PGM image (NULL skips it) */
+extern void    abyss_frag_print(uint32_t width, const char * pgm_path);
+
+/* hashes the contents of the logged blocks on a background thread, from
+ * small copies taken under the log lock. print waits for the scan
+ * and reports the identical blocks per site and the bytes interning them
+ * would save */
+extern int     abyss_dedup_scan();
+extern void    abyss_dedup_print(uint32_t top);
+
+/* copy traffic per call site, in log2 size buckets. the macros below
+ * replace the libc calls, so include this header after string.h */
+extern void *  abyss_memcpy(void * dest, const void * src, size_t n, char * file_name, uint32_t line_number);
+extern void *  abyss_memmove(void * dest, const void * src, size_t n, char * file_name, uint32_t line_number);
+extern void *  abyss_memset(void * dest, int c, size_t n, char * file_name, uint32_t line_number);
+extern char *  abyss_strdup(const char * s, char * file_name, uint32_t line_number);
+extern void    abyss_copies_print(uint32_t top);
+
 #ifndef ABYSS_C
 #define calloc(nitems,size) abyss_calloc(nitems, size, __FILE__, __LINE__)
 #define malloc(size)        abyss_malloc(size, __FILE__, __LINE__)
 #define realloc(ptr,size)   abyss_realloc(ptr, size, __FILE__, __LINE__)
-#define free(ptr)           abyss_free(ptr)
+#define free(ptr)           abyss_free(ptr, __FILE__, __LINE__)
+#define memcpy(dest,src,n)  abyss_memcpy(dest, src, n, __FILE__, __LINE__)
+#define memmove(dest,src,n) abyss_memmove(dest, src, n, __FILE__, __LINE__)
+#define memset(dest,c,n)    abyss_memset(dest, c, n, __FILE__, __LINE__)
+#define strdup(s)           abyss_strdup(s, __FILE__, __LINE__)
 #endif // !ABISS_C
 
+#else
+
+#define abyss_no_alloc_begin()
+#define abyss_no_alloc_end()
+
 #endif // DEBUG
 
 #endif // !ABYSS_H
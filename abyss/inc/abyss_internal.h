@@ -0,0 +1,80 @@
+#ifndef ABYSS_INTERNAL_H
+#define ABYSS_INTERNAL_H
+
+/* state the src/ files share behind the wrappers, not part of the api */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARR_SIZE 1<<8
+
+typedef struct {            /* 32 */
+    void * address;         /*  8 */
+    size_t size;            /*  8 */
+    char * file_name;       /*  8 */
+    uint32_t line_number;   /*  4 */
+    uint32_t scope;         /*  4 */
+} Meta_Ptr;
+
+typedef struct {
+    uint32_t len;
+    Meta_Ptr arr[ARR_SIZE];
+} Meta_Ptr_Array;
+
+extern Meta_Ptr_Array unfreed_soul_logs;
+
+/* held while the log changes and while a logged block is released, so the
+ * dedup scanner never reads a block that is being freed. a mutex rather
+ * than a spin lock: a waiter sleeps instead of spinning through a time
+ * slice when the holder is preempted */
+extern pthread_mutex_t soul_lock;
+
+static inline void soul_lock_take()
+{
+    pthread_mutex_lock(&soul_lock);
+}
+
+static inline void soul_lock_drop()
+{
+    pthread_mutex_unlock(&soul_lock);
+}
+
+/* log2 size histograms of the scope and copy reports. bucket b > 0 holds
+ * (2^(b-2), 2^(b-1)], so a power of two is reported as itself. sizes past
+ * the last of the buckets land in it */
+static inline uint32_t abyss_log2_bucket(uint64_t n, uint32_t buckets)
+{
+    uint32_t bucket = n > 1 ? 65u - (uint32_t)__builtin_clzll(n - 1) : (uint32_t)n;
+    return bucket < buckets ? bucket : buckets - 1;
+}
+
+/* upper bound of the bucket holding the p-th quantile of total samples */
+static inline uint64_t abyss_log2_percentile(const uint64_t * hist, uint32_t buckets, uint64_t total, double p)
+{
+    uint64_t rank = (uint64_t)(p * (double)total), seen = 0;
+    for ( uint32_t b = 0; b < buckets; b++ ) {
+        seen += hist[b];
+        if ( seen > rank )
+            return b ? 1ull << (b - 1) : 0;
+    }
+    return 0;
+}
+
+/* copies the log into out (ARR_SIZE entries) under soul_lock, returns
+ * the entry count. the blocks may be freed once the lock is dropped */
+uint32_t abyss_log_snapshot(Meta_Ptr * out);
+
+/* gives a block back to the backend it came from, or to libc when the
+ * backend did not hand it out (abyss.c) */
+void abyss_backend_release(void * ptr);
+
+/* 0 when ptr cannot have come from backend (backend.c) */
+int  abyss_backend_owns(const Abyss_Backend * backend, const void * ptr);
+
+/* recycle.c, consulted by the wrappers while abyss_recycle_on is set */
+extern int abyss_recycle_on;
+void * abyss_recycle_get(size_t size, char * file_name, uint32_t line_number);
+int    abyss_recycle_put(void * ptr, size_t size, char * file_name, uint32_t line_number);
+
+#endif // !ABYSS_INTERNAL_H
@@ -0,0 +1,90 @@
+#ifndef ABYSS_PERSIST_H
+#define ABYSS_PERSIST_H
+
+#include <stdint.h>
+
+/* on-disk layout of the registry written by abyss_persist. the file is a
+ * MAP_SHARED mapping, so it holds the last state even after a crash. bump
+ * ABYSS_PERSIST_VERSION on any layout change */
+#define ABYSS_PERSIST_MAGIC   "ABYSSREG"
+#define ABYSS_PERSIST_VERSION 1
+#define ABYSS_PERSIST_ENTRIES (1<<8)
+#define ABYSS_PERSIST_SITES   128
+#define ABYSS_PERSIST_NAME    48
+
+typedef struct {
+    uint64_t address;
+    uint64_t size;
+    uint32_t line_number;
+    uint32_t site;
+    char file_name[ABYSS_PERSIST_NAME];
+} Abyss_Persist_Entry;
+
+typedef struct {
+    uint32_t line_number;
+    uint32_t pad;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+    char file_name[ABYSS_PERSIST_NAME];
+} Abyss_Persist_Site;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t site_size;
+    uint32_t entries_max;
+    uint32_t sites_max;
+    int32_t pid;
+    uint64_t start_time;
+    uint64_t last_time;
+    uint64_t updates;
+    uint32_t len;
+    uint32_t sites_len;
+    Abyss_Persist_Entry entries[ABYSS_PERSIST_ENTRIES];
+    Abyss_Persist_Site sites[ABYSS_PERSIST_SITES];
+} Abyss_Persist;
+
+/* shared region for pre-fork worker pools, set up by abyss_workers_create
+ * in the parent. each worker owns one slot and is its only writer, seq is
+ * odd while an update is in flight (a seqlock) */
+#define ABYSS_WORKERS_MAGIC   "ABYSSWRK"
+#define ABYSS_WORKERS_VERSION 1
+#define ABYSS_WORKERS_MAX     64
+#define ABYSS_WORKER_SITES    64
+
+typedef struct {
+    uint32_t line_number;
+    uint32_t pad;
+    uint64_t allocs;
+    uint64_t live_bytes;
+    char file_name[ABYSS_PERSIST_NAME];
+} Abyss_Worker_Site;
+
+typedef struct {
+    uint64_t seq;
+    int32_t pid;
+    uint32_t sites_len;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+    Abyss_Worker_Site sites[ABYSS_WORKER_SITES];
+} Abyss_Worker;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t worker_size;
+    uint32_t workers;
+    uint32_t pad;
+    Abyss_Worker slots[];
+} Abyss_Workers;
+
+/* totals across workers, per-site totals and the workers whose live bytes
+ * are far from the median. reads the slots without stopping the writers */
+extern void abyss_workers_report(const Abyss_Workers * image);
+
+#endif // !ABYSS_PERSIST_H
@@ -1,72 +1,697 @@
 
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define ABYSS_C
 #include "../inc/abyss.h"
+#include "../inc/abyss_persist.h"
+#include "../inc/abyss_internal.h"
+
+#ifdef ABYSS_TIMEKEEPER
+#include "../../timekeeper/inc/timekeeper_inline.h"
+#define abyss_charge_zone(size) timekeeper_zone_alloc(size)
+#else
+#define abyss_charge_zone(size)
+#endif
 
-#define ARR_SIZE 1<<8
 #define NULL_PTR 0
 
-typedef struct {            /* 32 */
-    void * address;         /*  8 */
-    size_t size;            /*  8 */
-    char * file_name;       /*  8 */
-    uint32_t line_number;   /*  4 */
-} Meta_Ptr;
+Meta_Ptr_Array unfreed_soul_logs;
+static Abyss_Alloc_Hook alloc_hook;
+
+pthread_mutex_t soul_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const Abyss_Backend * backend = &abyss_backend_libc;
+
+/* blocks handed out by the backend and not yet released to it, counted
+ * apart from the log so blocks past its end and blocks parked in the
+ * recycle caches are live too */
+static int64_t backend_live;
+
+static void * backend_alloc(size_t size)
+{
+    void * ptr = backend->alloc(size);
+    if ( ptr )
+        __atomic_add_fetch(&backend_live, 1, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+static void * backend_zalloc(size_t nitems, size_t size)
+{
+    void * ptr = backend->zalloc(nitems, size);
+    if ( ptr )
+        __atomic_add_fetch(&backend_live, 1, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+static void * backend_resize(void * ptr, size_t size)
+{
+    if ( ptr && !abyss_backend_owns(backend, ptr) )
+        return realloc(ptr, size);
+
+    void * new_ptr = backend->resize(ptr, size);
+    if ( new_ptr && !ptr )
+        __atomic_add_fetch(&backend_live, 1, __ATOMIC_RELAXED);
+    return new_ptr;
+}
+
+void abyss_backend_release(void * ptr)
+{
+    if ( !ptr )
+        return;
+    /* not from the backend: libc handed it out behind the wrappers */
+    if ( !abyss_backend_owns(backend, ptr) ) {
+        free(ptr);
+        return;
+    }
+    backend->release(ptr);
+    __atomic_sub_fetch(&backend_live, 1, __ATOMIC_RELAXED);
+}
+
+int abyss_set_backend(const Abyss_Backend * next)
+{
+    if ( !next || !next->alloc || !next->zalloc || !next->resize || !next->release )
+        return -1;
+    if ( next == backend )
+        return 0;
+
+    /* blocks must go back to the allocator they came from. the calling
+     * thread's cached blocks are released, other threads' still count */
+    abyss_recycle_flush();
+    if ( __atomic_load_n(&backend_live, __ATOMIC_RELAXED) > 0 )
+        return -1;
+
+    backend = next;
+    return 0;
+}
+
+const Abyss_Backend * abyss_get_backend()
+{
+    return backend;
+}
+
+void abyss_set_alloc_hook(Abyss_Alloc_Hook hook)
+{
+    alloc_hook = hook;
+}
+
+#define NO_ALLOC_SITES 64
 
 typedef struct {
-    uint32_t len;
-    Meta_Ptr arr[ARR_SIZE];
-} Meta_Ptr_Array;
+    const char * call;
+    char * file_name;
+    uint32_t line_number;
+    uint64_t count;
+} No_Alloc_Site;
+
+_Thread_local uint32_t abyss_no_alloc_depth;
+
+static No_Alloc_Site no_alloc_sites[NO_ALLOC_SITES];
+static uint32_t no_alloc_len;
+static int no_alloc_lock;
+static int no_alloc_strict;
 
-static Meta_Ptr_Array unfreed_soul_logs;
+void abyss_no_alloc_strict(int strict)
+{
+    no_alloc_strict = strict;
+}
+
+/* slow path, only reached inside a region */
+static void abyss_no_alloc_violation(const char * call, char * file_name, uint32_t line_number)
+{
+    if ( no_alloc_strict ) {
+        fprintf(stderr, "abyss: %s at %s:%u inside a no-alloc region\n", call, file_name, line_number);
+        abort();
+    }
+
+    while ( __atomic_exchange_n(&no_alloc_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+
+    uint32_t i;
+    for ( i = 0; i < no_alloc_len; i++ ) {
+        No_Alloc_Site * site = &no_alloc_sites[i];
+        if ( site->line_number == line_number && site->call == call && site->file_name == file_name )
+            break;
+    }
+    if ( i == no_alloc_len && no_alloc_len < NO_ALLOC_SITES ) {
+        no_alloc_sites[i].call = call;
+        no_alloc_sites[i].file_name = file_name;
+        no_alloc_sites[i].line_number = line_number;
+        no_alloc_len++;
+    }
+    if ( i < NO_ALLOC_SITES )
+        no_alloc_sites[i].count++;
+
+    __atomic_store_n(&no_alloc_lock, 0, __ATOMIC_RELEASE);
+}
 
+#define abyss_no_alloc_check(call, file_name, line_number) \
+    if ( abyss_no_alloc_depth ) abyss_no_alloc_violation(call, file_name, line_number)
+
+#define SCOPE_TYPES   32
+#define SCOPE_BUCKETS 48        /* log2(bytes) */
+
+typedef struct {
+    const char * type;
+    uint32_t id;
+    Abyss_Scope_Stats stats;
+    uint64_t live_bytes;
+} Scope;
+
+typedef struct {
+    const char * type;
+    uint64_t requests;
+    uint64_t leaking;           /* requests that left memory behind */
+    uint64_t allocated_bytes;
+    uint64_t leaked_bytes;
+    uint64_t allocated_hist[SCOPE_BUCKETS];
+    uint64_t peak_hist[SCOPE_BUCKETS];
+    uint64_t leaked_hist[SCOPE_BUCKETS];
+} Scope_Type;
+
+static _Thread_local Scope scope_current;
+static uint32_t scope_ids;
+
+static Scope_Type scope_types[SCOPE_TYPES];
+static uint32_t scope_types_len;
+static int scope_lock;
+
+int abyss_scope_begin(const char * type)
+{
+    if ( scope_current.id )
+        return -1;
+
+    scope_current.type = type;
+    scope_current.id = __atomic_add_fetch(&scope_ids, 1, __ATOMIC_RELAXED);
+    scope_current.live_bytes = 0;
+    scope_current.stats = (Abyss_Scope_Stats){ 0, 0, 0, 0 };
+    return 0;
+}
+
+static void abyss_scope_alloc(Meta_Ptr * entry, size_t old_size, size_t size)
+{
+    if ( !scope_current.id )
+        return;
+
+    scope_current.stats.allocations++;
+    scope_current.stats.allocated_bytes += size;
+    if ( !entry || entry->scope != scope_current.id )
+        return;
+
+    scope_current.live_bytes += size - old_size;
+    if ( scope_current.live_bytes > scope_current.stats.peak_live_bytes )
+        scope_current.stats.peak_live_bytes = scope_current.live_bytes;
+}
+
+Abyss_Scope_Stats abyss_scope_end()
+{
+    Abyss_Scope_Stats stats = scope_current.stats;
+
+    if ( !scope_current.id )
+        return stats;
+
+    stats.leaked_bytes = scope_current.live_bytes;
+    scope_current.id = 0;
+
+    while ( __atomic_exchange_n(&scope_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+
+    uint32_t i;
+    for ( i = 0; i < scope_types_len; i++ )
+        if ( scope_types[i].type == scope_current.type || !strcmp(scope_types[i].type, scope_current.type) )
+            break;
+    if ( i == scope_types_len && scope_types_len < SCOPE_TYPES )
+        scope_types[scope_types_len++].type = scope_current.type;
+
+    if ( i < SCOPE_TYPES ) {
+        Scope_Type * type = &scope_types[i];
+        type->requests++;
+        type->leaking += stats.leaked_bytes != 0;
+        type->allocated_bytes += stats.allocated_bytes;
+        type->leaked_bytes += stats.leaked_bytes;
+        type->allocated_hist[abyss_log2_bucket(stats.allocated_bytes, SCOPE_BUCKETS)]++;
+        type->peak_hist[abyss_log2_bucket(stats.peak_live_bytes, SCOPE_BUCKETS)]++;
+        type->leaked_hist[abyss_log2_bucket(stats.leaked_bytes, SCOPE_BUCKETS)]++;
+    }
+
+    __atomic_store_n(&scope_lock, 0, __ATOMIC_RELEASE);
+    return stats;
+}
+
+/* per request type: mean and p50/p99 of allocated bytes, p99 of the peak
+ * (the arena size that fits 99% of requests) and how much each type
+ * leaves behind on the heap */
+void abyss_scope_print()
+{
+    printf(" type             │ requests │ alloc mean │ alloc p50  │ alloc p99  │ peak p99   │ leaking │ leaked(B)\n");
+    printf("──────────────────┼──────────┼────────────┼────────────┼────────────┼────────────┼─────────┼──────────\n");
+    for ( uint32_t i = 0; i < scope_types_len; i++ ) {
+        Scope_Type * type = &scope_types[i];
+        printf(" %-16s │ %-8llu │ %-10llu │ %-10llu │ %-10llu │ %-10llu │ %6.1f%% │ %llu\n"
+               ,type->type, (unsigned long long)type->requests
+               ,(unsigned long long)(type->allocated_bytes / type->requests)
+               ,(unsigned long long)abyss_log2_percentile(type->allocated_hist, SCOPE_BUCKETS, type->requests, 0.50)
+               ,(unsigned long long)abyss_log2_percentile(type->allocated_hist, SCOPE_BUCKETS, type->requests, 0.99)
+               ,(unsigned long long)abyss_log2_percentile(type->peak_hist, SCOPE_BUCKETS, type->requests, 0.99)
+               ,(double)type->leaking * 100.0 / type->requests
+               ,(unsigned long long)type->leaked_bytes);
+    }
+    printf("──────────────────┴──────────┴────────────┴────────────┴────────────┴────────────┴─────────┴──────────\n");
+}
+
+void abyss_no_alloc_print()
+{
+    printf(" call     │ file             │ line     │ count\n");
+    printf("──────────┼──────────────────┼──────────┼──────────\n");
+    for ( uint32_t i = 0; i < no_alloc_len; i++ )
+        printf(" %-8s │ %-16s │ %-8u │ %llu\n", no_alloc_sites[i].call, no_alloc_sites[i].file_name
+               ,no_alloc_sites[i].line_number, (unsigned long long)no_alloc_sites[i].count);
+    printf("──────────┴──────────────────┴──────────┴──────────\n");
+}
+
+/* blocks allocated while the log was full, kept by address so that
+ * freeing or resizing them still reaches the worker and persisted
+ * counters. open addressing with backward shift deletion, under
+ * soul_lock. once it is PAST_LOG_FILL full, new blocks are counted at
+ * allocation only */
+#define PAST_LOG_SIZE (1<<16)   /* power of two */
+#define PAST_LOG_FILL (PAST_LOG_SIZE / 4 * 3)
+
+static Meta_Ptr past_log[PAST_LOG_SIZE];
+static uint32_t past_log_len;
+
+static uint32_t past_log_home(const void * address)
+{
+    return (uint32_t)(((uintptr_t)address >> 4) * 2654435761u) & (PAST_LOG_SIZE - 1);
+}
+
+static void past_log_add(void * address, size_t size, char * file_name, uint32_t line_number)
+{
+    if ( past_log_len == PAST_LOG_FILL )
+        return;
+
+    uint32_t i = past_log_home(address);
+    while ( past_log[i].address )
+        i = (i + 1) & (PAST_LOG_SIZE - 1);
+    past_log[i] = (Meta_Ptr){ address, size, file_name, line_number, 0 };
+    past_log_len++;
+}
+
+/* moves the entry of address to out, 0 when it is not there */
+static int past_log_take(const void * address, Meta_Ptr * out)
+{
+    if ( !past_log_len || !address )
+        return 0;
+
+    uint32_t i = past_log_home(address);
+    while ( past_log[i].address != address ) {
+        if ( !past_log[i].address )
+            return 0;
+        i = (i + 1) & (PAST_LOG_SIZE - 1);
+    }
+    *out = past_log[i];
+
+    /* pull back later entries of the run whose home is not between the
+     * hole and themselves, so no probe sequence is cut short */
+    for ( uint32_t j = (i + 1) & (PAST_LOG_SIZE - 1); past_log[j].address; j = (j + 1) & (PAST_LOG_SIZE - 1) ) {
+        uint32_t home = past_log_home(past_log[j].address);
+        if ( ((j - home) & (PAST_LOG_SIZE - 1)) >= ((j - i) & (PAST_LOG_SIZE - 1)) ) {
+            past_log[i] = past_log[j];
+            i = j;
+        }
+    }
+    past_log[i].address = NULL;
+    past_log_len--;
+    return 1;
+}
+
+_Static_assert(ABYSS_PERSIST_ENTRIES == (ARR_SIZE), "persisted log must match the in-memory one");
+
+static Abyss_Persist * persist;
+static char * persist_names[ABYSS_PERSIST_SITES];   /* in-process keys of persist->sites */
+
+/* keeps the tail of long paths, the file name is the useful part */
+static void persist_name(char * out, const char * file_name)
+{
+    size_t len = strlen(file_name);
+    if ( len >= ABYSS_PERSIST_NAME )
+        file_name += len - (ABYSS_PERSIST_NAME - 1);
+    snprintf(out, ABYSS_PERSIST_NAME, "%s", file_name);
+}
+
+static uint32_t persist_site(char * file_name, uint32_t line_number)
+{
+    uint32_t i;
+    for ( i = 0; i < persist->sites_len; i++ )
+        if ( persist->sites[i].line_number == line_number && persist_names[i] == file_name )
+            return i;
+    if ( i == ABYSS_PERSIST_SITES )
+        return ABYSS_PERSIST_SITES;
+
+    Abyss_Persist_Site * site = &persist->sites[i];
+    memset(site, 0, sizeof(*site));
+    site->line_number = line_number;
+    persist_name(site->file_name, file_name);
+    persist_names[i] = file_name;
+    persist->sites_len++;
+    return i;
+}
+
+static void persist_touch()
+{
+    persist->updates++;
+    persist->last_time = (uint64_t)time(NULL);
+}
+
+/* charges or credits size to the counters of a site, returns its index */
+static uint32_t persist_count(char * file_name, uint32_t line_number, size_t size, int alloc)
+{
+    uint32_t i = persist_site(file_name, line_number);
+    if ( i == ABYSS_PERSIST_SITES )
+        return i;
+
+    Abyss_Persist_Site * site = &persist->sites[i];
+    if ( alloc ) {
+        site->allocs++;
+        site->live_bytes += size;
+        if ( site->live_bytes > site->peak_live_bytes )
+            site->peak_live_bytes = site->live_bytes;
+    } else {
+        site->frees++;
+        site->live_bytes -= size;
+    }
+    return i;
+}
+
+/* entries are written before len covers them, so a crash mid-update
+ * leaves a consistent prefix */
+static void abyss_persist_alloc(uint32_t i)
+{
+    Meta_Ptr * entry = &unfreed_soul_logs.arr[i];
+    Abyss_Persist_Entry * out = &persist->entries[i];
+
+    out->address = (uint64_t)(uintptr_t)entry->address;
+    out->size = entry->size;
+    out->line_number = entry->line_number;
+    out->site = persist_count(entry->file_name, entry->line_number, entry->size, 1);
+    persist_name(out->file_name, entry->file_name);
+
+    persist->len = unfreed_soul_logs.len;
+    persist_touch();
+}
+
+/* blocks past the log have no entry, only their site counters move */
+static void abyss_persist_past(char * file_name, uint32_t line_number, size_t size, int alloc)
+{
+    persist_count(file_name, line_number, size, alloc);
+    persist_touch();
+}
+
+static void abyss_persist_resize(uint32_t i)
+{
+    Abyss_Persist_Entry * out = &persist->entries[i];
+
+    /* the block moves to the realloc call site */
+    if ( out->site < ABYSS_PERSIST_SITES ) {
+        persist->sites[out->site].frees++;
+        persist->sites[out->site].live_bytes -= out->size;
+    }
+    abyss_persist_alloc(i);
+}
+
+/* mirrors the swap with the last entry done by abyss_free */
+static void abyss_persist_remove(uint32_t i)
+{
+    Abyss_Persist_Entry * out = &persist->entries[i];
+
+    if ( out->site < ABYSS_PERSIST_SITES ) {
+        persist->sites[out->site].frees++;
+        persist->sites[out->site].live_bytes -= out->size;
+    }
+    *out = persist->entries[persist->len - 1];
+    persist->len--;
+    persist_touch();
+}
+
+int abyss_persist(const char * path)
+{
+    if ( persist )
+        return -1;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ( fd < 0 )
+        return -1;
+    if ( ftruncate(fd, sizeof(Abyss_Persist)) ) {
+        close(fd);
+        return -1;
+    }
+    void * map = mmap(NULL, sizeof(Abyss_Persist), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( map == MAP_FAILED )
+        return -1;
+
+    persist = map;
+    memcpy(persist->magic, ABYSS_PERSIST_MAGIC, sizeof(persist->magic));
+    persist->version = ABYSS_PERSIST_VERSION;
+    persist->entry_size = sizeof(Abyss_Persist_Entry);
+    persist->site_size = sizeof(Abyss_Persist_Site);
+    persist->entries_max = ABYSS_PERSIST_ENTRIES;
+    persist->sites_max = ABYSS_PERSIST_SITES;
+    persist->pid = (int32_t)getpid();
+    persist->start_time = (uint64_t)time(NULL);
+
+    for ( uint32_t i = 0; i < unfreed_soul_logs.len; i++ )
+        abyss_persist_alloc(i);
+    persist->len = unfreed_soul_logs.len;
+    for ( uint32_t i = 0; past_log_len && i < PAST_LOG_SIZE; i++ )
+        if ( past_log[i].address )
+            persist_count(past_log[i].file_name, past_log[i].line_number, past_log[i].size, 1);
+    return 0;
+}
+
+static Abyss_Workers * workers_image;
+static Abyss_Worker * worker;       /* this process's slot once joined */
+static char * worker_names[ABYSS_WORKER_SITES];
+
+static void abyss_worker_update(char * file_name, uint32_t line_number, size_t size, int alloc);
+
+int abyss_workers_create(const char * path, uint32_t workers)
+{
+    size_t size = sizeof(Abyss_Workers) + workers * sizeof(Abyss_Worker);
+    int fd = -1, flags = MAP_SHARED | MAP_ANONYMOUS;
+
+    if ( workers_image || !workers || workers > ABYSS_WORKERS_MAX )
+        return -1;
+
+    if ( path ) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if ( fd < 0 )
+            return -1;
+        if ( ftruncate(fd, size) ) {
+            close(fd);
+            return -1;
+        }
+        flags = MAP_SHARED;
+    }
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if ( fd >= 0 )
+        close(fd);
+    if ( map == MAP_FAILED )
+        return -1;
+
+    workers_image = map;
+    memcpy(workers_image->magic, ABYSS_WORKERS_MAGIC, sizeof(workers_image->magic));
+    workers_image->version = ABYSS_WORKERS_VERSION;
+    workers_image->worker_size = sizeof(Abyss_Worker);
+    workers_image->workers = workers;
+    return 0;
+}
+
+int abyss_workers_join(uint32_t slot)
+{
+    if ( !workers_image || slot >= workers_image->workers )
+        return -1;
+
+    worker = &workers_image->slots[slot];
+    memset(worker, 0, sizeof(*worker));
+    worker->pid = (int32_t)getpid();
+
+    /* blocks inherited from the parent are seeded as live, so freeing
+     * them in the worker does not underflow the counters */
+    soul_lock_take();
+    for ( uint32_t i = 0; i < unfreed_soul_logs.len; i++ ) {
+        Meta_Ptr * entry = &unfreed_soul_logs.arr[i];
+        abyss_worker_update(entry->file_name, entry->line_number, entry->size, 1);
+    }
+    for ( uint32_t i = 0; past_log_len && i < PAST_LOG_SIZE; i++ )
+        if ( past_log[i].address )
+            abyss_worker_update(past_log[i].file_name, past_log[i].line_number, past_log[i].size, 1);
+    worker->allocs = 0;
+    for ( uint32_t i = 0; i < worker->sites_len; i++ )
+        worker->sites[i].allocs = 0;
+    soul_lock_drop();
+    return 0;
+}
+
+void abyss_workers_print()
+{
+    if ( workers_image )
+        abyss_workers_report(workers_image);
+}
+
+/* single writer per slot, readers retry while seq is odd */
+static void abyss_worker_update(char * file_name, uint32_t line_number, size_t size, int alloc)
+{
+    uint32_t i;
+
+    __atomic_store_n(&worker->seq, worker->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if ( alloc ) {
+        worker->allocs++;
+        worker->live_bytes += size;
+        if ( worker->live_bytes > worker->peak_live_bytes )
+            worker->peak_live_bytes = worker->live_bytes;
+    } else {
+        worker->frees++;
+        worker->live_bytes -= size;
+    }
+
+    for ( i = 0; i < worker->sites_len; i++ )
+        if ( worker->sites[i].line_number == line_number && worker_names[i] == file_name )
+            break;
+    if ( i == worker->sites_len && i < ABYSS_WORKER_SITES ) {
+        worker->sites[i].line_number = line_number;
+        persist_name(worker->sites[i].file_name, file_name);
+        worker_names[i] = file_name;
+        worker->sites_len++;
+    }
+    if ( i < ABYSS_WORKER_SITES ) {
+        worker->sites[i].allocs += alloc;
+        worker->sites[i].live_bytes += alloc ? size : -size;
+    }
+
+    __atomic_store_n(&worker->seq, worker->seq + 1, __ATOMIC_RELEASE);
+}
 
 void * abyss_calloc(size_t nitems, size_t size, char * file_name, uint32_t line_number)
 {
-    void * ptr = calloc(nitems, size);  
+    abyss_no_alloc_check("calloc", file_name, line_number);
+
+    void * ptr = abyss_recycle_on ? abyss_recycle_get(size*nitems, file_name, line_number) : NULL_PTR;
+
+    if ( ptr )
+        memset(ptr, 0, size*nitems);
+    else
+        ptr = backend_zalloc(nitems, size);
 
     if ( !ptr )
         return NULL_PTR;
 
-    if ( unfreed_soul_logs.len == ARR_SIZE ) 
+    abyss_charge_zone(size*nitems);
+    if ( alloc_hook )
+        alloc_hook(ptr, size*nitems);
+
+    soul_lock_take();
+    if ( unfreed_soul_logs.len == ARR_SIZE ) {
+        abyss_scope_alloc(NULL, 0, size*nitems);
+        past_log_add(ptr, size*nitems, file_name, line_number);
+        if ( persist )
+            abyss_persist_past(file_name, line_number, size*nitems, 1);
+        if ( worker )
+            abyss_worker_update(file_name, line_number, size*nitems, 1);
+        soul_lock_drop();
         return ptr;
+    }
 
     Meta_Ptr * new_entry = &unfreed_soul_logs.arr[unfreed_soul_logs.len++];    
     new_entry->address = ptr;
     new_entry->size = size*nitems;
     new_entry->file_name = file_name;
     new_entry->line_number = line_number;
+    new_entry->scope = scope_current.id;
+    abyss_scope_alloc(new_entry, 0, size*nitems);
+    if ( persist )
+        abyss_persist_alloc(unfreed_soul_logs.len - 1);
+    if ( worker )
+        abyss_worker_update(file_name, line_number, size*nitems, 1);
+    soul_lock_drop();
 
     return ptr;
 }
 
 void * abyss_malloc(size_t size, char * file_name, uint32_t line_number)
 {
-    void * ptr = malloc(size); 
+    abyss_no_alloc_check("malloc", file_name, line_number);
+
+    void * ptr = abyss_recycle_on ? abyss_recycle_get(size, file_name, line_number) : NULL_PTR;
+
+    if ( !ptr )
+        ptr = backend_alloc(size);
 
     if ( !ptr )
         return NULL_PTR;
+
+    abyss_charge_zone(size);
+    if ( alloc_hook )
+        alloc_hook(ptr, size);
     
-    if ( unfreed_soul_logs.len == ARR_SIZE ) 
+    soul_lock_take();
+    if ( unfreed_soul_logs.len == ARR_SIZE ) {
+        abyss_scope_alloc(NULL, 0, size);
+        past_log_add(ptr, size, file_name, line_number);
+        if ( persist )
+            abyss_persist_past(file_name, line_number, size, 1);
+        if ( worker )
+            abyss_worker_update(file_name, line_number, size, 1);
+        soul_lock_drop();
         return ptr;
+    }
 
     Meta_Ptr * new_entry = &unfreed_soul_logs.arr[unfreed_soul_logs.len++];    
     new_entry->address = ptr;
     new_entry->size = size;
     new_entry->file_name = file_name;
     new_entry->line_number = line_number;
+    new_entry->scope = scope_current.id;
+    abyss_scope_alloc(new_entry, 0, size);
+    if ( persist )
+        abyss_persist_alloc(unfreed_soul_logs.len - 1);
+    if ( worker )
+        abyss_worker_update(file_name, line_number, size, 1);
+    soul_lock_drop();
 
     return ptr;
 }
 
 void * abyss_realloc(void * ptr, size_t size, char * file_name, uint32_t line_number)
 {
-    void * new_ptr = realloc(ptr, size);
+    abyss_no_alloc_check("realloc", file_name, line_number);
+
+    soul_lock_take();
+    void * new_ptr = backend_resize(ptr, size);
+
+    if ( !new_ptr ) {
+        soul_lock_drop();
+        return NULL_PTR;
+    }
 
-    if ( !new_ptr ) return NULL_PTR;
+    abyss_charge_zone(size);
+    if ( alloc_hook )
+        alloc_hook(new_ptr, size);
 
     Meta_Ptr *entry, *last_entry;
 
@@ -75,32 +700,89 @@ void * abyss_realloc(void * ptr, size_t size, char * file_name, uint32_t line_nu
     for ( entry = &unfreed_soul_logs.arr[0]; entry != last_entry; entry++)
     {
         if ( entry->address == ptr ) {
+            abyss_scope_alloc(entry, entry->size, size);
+            if ( worker ) {
+                abyss_worker_update(entry->file_name, entry->line_number, entry->size, 0);
+                abyss_worker_update(file_name, line_number, size, 1);
+            }
             entry->address = new_ptr;
             entry->size = size;
             entry->file_name = file_name;
             entry->line_number = line_number;
-            break;
+            if ( persist )
+                abyss_persist_resize(entry - unfreed_soul_logs.arr);
+            soul_lock_drop();
+            return new_ptr;
+        }
+    }
+
+    /* a block past the log stays there under its new address */
+    Meta_Ptr past;
+    if ( past_log_take(ptr, &past) ) {
+        past_log_add(new_ptr, size, file_name, line_number);
+        if ( persist ) {
+            abyss_persist_past(past.file_name, past.line_number, past.size, 0);
+            abyss_persist_past(file_name, line_number, size, 1);
+        }
+        if ( worker ) {
+            abyss_worker_update(past.file_name, past.line_number, past.size, 0);
+            abyss_worker_update(file_name, line_number, size, 1);
         }
     }
+    abyss_scope_alloc(NULL, 0, size);
+    soul_lock_drop();
     return new_ptr;
 }
 
-void abyss_free(void * ptr)
+void abyss_free(void * ptr, char * file_name, uint32_t line_number)
 {
     Meta_Ptr *entry, *last_entry;
 
+    abyss_no_alloc_check("free", file_name, line_number);
+
+    soul_lock_take();
     last_entry = &unfreed_soul_logs.arr[unfreed_soul_logs.len];
 
     for ( entry = &unfreed_soul_logs.arr[0]; entry != last_entry; entry++)
     {
         if ( entry->address == ptr ) {
-            free(ptr);
-
-            *entry = *last_entry;
-            unfreed_soul_logs.len--;
-            return;
+            if ( scope_current.id && entry->scope == scope_current.id )
+                scope_current.live_bytes -= entry->size;
+            if ( persist )
+                abyss_persist_remove(entry - unfreed_soul_logs.arr);
+            if ( worker )
+                abyss_worker_update(entry->file_name, entry->line_number, entry->size, 0);
+            if ( abyss_recycle_on && abyss_recycle_put(ptr, entry->size, entry->file_name, entry->line_number) ) {
+                *entry = unfreed_soul_logs.arr[--unfreed_soul_logs.len];
+                soul_lock_drop();
+                return;
+            }
+            *entry = unfreed_soul_logs.arr[--unfreed_soul_logs.len];
+            break;
         }
     }
+
+    /* blocks that did not fit in the log are freed all the same */
+    Meta_Ptr past;
+    if ( entry == last_entry && past_log_take(ptr, &past) ) {
+        if ( persist )
+            abyss_persist_past(past.file_name, past.line_number, past.size, 0);
+        if ( worker )
+            abyss_worker_update(past.file_name, past.line_number, past.size, 0);
+    }
+    abyss_backend_release(ptr);
+    soul_lock_drop();
+}
+
+/* copies the log under its lock, for readers that walk it while other
+ * threads allocate and free. returns the entry count */
+uint32_t abyss_log_snapshot(Meta_Ptr * out)
+{
+    soul_lock_take();
+    uint32_t len = unfreed_soul_logs.len;
+    memcpy(out, unfreed_soul_logs.arr, len * sizeof(Meta_Ptr));
+    soul_lock_drop();
+    return len;
 }
 
 void abyss_print() 
@@ -124,3 +806,255 @@ void abyss_print()
     printf("────────────────────────────────────────────────────────\n");
 }
 
+#define DEDUP_PREVIEW 16
+#define DEDUP_CHUNK   (16<<10) /* copied per lock hold, a multiple of 512 */
+#define DEDUP_STRIPE  32
+#define DEDUP_SCRAMBLE 16        /* stripes between lane scrambles */
+#define DEDUP_P1 0x9e3779b185ebca87ull
+#define DEDUP_P2 0xc2b2ae3d27d4eb4full
+#define DEDUP_P3 0x165667b19e3779f9ull
+
+typedef struct {
+    void * address;
+    size_t size;
+    char * file_name;
+    uint32_t line_number;
+    int gone;                   /* freed before the scanner reached it */
+    uint64_t hash;
+    char preview[DEDUP_PREVIEW + 1];
+} Dedup_Block;
+
+typedef struct {
+    char * file_name;
+    uint32_t line_number;
+    uint32_t copies;
+    uint64_t saved;
+} Dedup_Site;
+
+static struct {
+    pthread_t thread;
+    int running;
+    uint32_t len;
+    uint64_t ns;
+    Dedup_Block blocks[ARR_SIZE];
+} dedup;
+
+static const uint64_t dedup_key[4] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull
+};
+
+typedef struct {
+    uint64_t acc[4];
+    uint64_t stripes;
+} Dedup_State;
+
+static inline uint64_t dedup_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* per 64 bit lane: acc += lo32(d ^ key) * hi32(d ^ key), plus the data of
+ * the neighbour lane. sse2 does two lanes per instruction, the scalar
+ * path gives the same hash on other targets */
+static void dedup_stripe(Dedup_State * state, const uint8_t * data)
+{
+#if defined(__SSE2__)
+    __m128i * acc = (__m128i *)state->acc;
+    for ( int half = 0; half < 2; half++ ) {
+        __m128i d = _mm_loadu_si128((const __m128i *)data + half);
+        __m128i k = _mm_xor_si128(d, _mm_loadu_si128((const __m128i *)dedup_key + half));
+        __m128i product = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+        __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i lanes = _mm_loadu_si128(acc + half);
+        _mm_storeu_si128(acc + half, _mm_add_epi64(lanes, _mm_add_epi64(product, swapped)));
+    }
+#else
+    uint64_t d[4];
+    memcpy(d, data, sizeof(d));
+    for ( int l = 0; l < 4; l++ ) {
+        uint64_t k = d[l] ^ dedup_key[l];
+        state->acc[l] += (k & 0xffffffffull) * (k >> 32) + d[l ^ 1];
+    }
+#endif
+    if ( ++state->stripes % DEDUP_SCRAMBLE == 0 )
+        for ( int l = 0; l < 4; l++ )
+            state->acc[l] = (state->acc[l] ^ (state->acc[l] >> 47) ^ dedup_key[l]) * DEDUP_P1;
+}
+
+/* len is a multiple of DEDUP_STRIPE except for the last call */
+static void dedup_update(Dedup_State * state, const uint8_t * data, size_t len)
+{
+    for ( size_t i = 0; i + DEDUP_STRIPE <= len; i += DEDUP_STRIPE )
+        dedup_stripe(state, data + i);
+}
+
+static uint64_t dedup_final(Dedup_State * state, const uint8_t * tail, size_t tail_len, uint64_t len)
+{
+    uint64_t hash = len * DEDUP_P3;
+    for ( int l = 0; l < 4; l++ )
+        hash = dedup_rotl(hash ^ state->acc[l], 27) * DEDUP_P1 + DEDUP_P2;
+    for ( size_t i = 0; i < tail_len; i++ )
+        hash = dedup_rotl(hash ^ (tail[i] * DEDUP_P3), 11) * DEDUP_P1;
+
+    hash ^= hash >> 33;
+    hash *= DEDUP_P2;
+    hash ^= hash >> 29;
+    hash *= DEDUP_P3;
+    return hash ^ (hash >> 32);
+}
+
+static int dedup_live(const Dedup_Block * block)
+{
+    for ( uint32_t e = 0; e < unfreed_soul_logs.len; e++ )
+        if ( unfreed_soul_logs.arr[e].address == block->address && unfreed_soul_logs.arr[e].size == block->size )
+            return 1;
+    return 0;
+}
+
+/* blocks are read in DEDUP_CHUNK copies taken under the log lock and
+ * hashed after dropping it, so the application waits for one small
+ * memcpy at most, whatever the block size */
+static void * dedup_loop(void * arg)
+{
+    static uint8_t chunk[DEDUP_CHUNK];
+    struct timespec start, end;
+
+    (void)arg;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+#ifdef SCHED_IDLE
+    /* only run on cpu time the application leaves idle */
+    struct sched_param param = { 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    soul_lock_take();
+    dedup.len = unfreed_soul_logs.len;
+    for ( uint32_t i = 0; i < dedup.len; i++ ) {
+        Meta_Ptr * entry = &unfreed_soul_logs.arr[i];
+        dedup.blocks[i] = (Dedup_Block){ entry->address, entry->size, entry->file_name
+                                        ,entry->line_number, 0, 0, { 0 } };
+    }
+    soul_lock_drop();
+
+    for ( uint32_t i = 0; i < dedup.len; i++ ) {
+        Dedup_Block * block = &dedup.blocks[i];
+        Dedup_State state = { { DEDUP_P1 + DEDUP_P2, DEDUP_P2, 0, -DEDUP_P1 }, 0 };
+        size_t done = 0, len = 0;
+
+        do {
+            soul_lock_take();
+            block->gone = !dedup_live(block);
+            if ( !block->gone ) {
+                len = block->size - done < DEDUP_CHUNK ? block->size - done : DEDUP_CHUNK;
+                memcpy(chunk, (const uint8_t *)block->address + done, len);
+            }
+            soul_lock_drop();
+            if ( block->gone )
+                break;
+
+            if ( !done )
+                for ( size_t c = 0; c < DEDUP_PREVIEW && c < len; c++ )
+                    block->preview[c] = chunk[c] >= 0x20 && chunk[c] < 0x7f ? (char)chunk[c] : '.';
+            dedup_update(&state, chunk, len);
+            done += len;
+        } while ( done < block->size );
+
+        if ( !block->gone )
+            block->hash = dedup_final(&state, chunk + len / DEDUP_STRIPE * DEDUP_STRIPE
+                                      ,len % DEDUP_STRIPE, block->size);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    dedup.ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ull + (uint64_t)(end.tv_nsec - start.tv_nsec);
+    return NULL;
+}
+
+int abyss_dedup_scan()
+{
+    if ( dedup.running )
+        return -1;
+    if ( pthread_create(&dedup.thread, NULL, dedup_loop, NULL) )
+        return -1;
+    dedup.running = 1;
+    return 0;
+}
+
+static int dedup_block_cmp(const void * a, const void * b)
+{
+    const Dedup_Block * da = a, * db = b;
+    if ( da->size != db->size )
+        return (da->size < db->size) - (da->size > db->size);
+    return (da->hash > db->hash) - (da->hash < db->hash);
+}
+
+static int dedup_site_cmp(const void * a, const void * b)
+{
+    uint64_t sa = ((const Dedup_Site *)a)->saved, sb = ((const Dedup_Site *)b)->saved;
+    return (sa < sb) - (sa > sb);
+}
+
+/* waits for the scan, then prints the largest groups of identical blocks
+ * and the sites whose copies interning would remove. the first block of
+ * a group is kept, the rest count as saved */
+void abyss_dedup_print(uint32_t top)
+{
+    static Dedup_Site sites[ARR_SIZE];
+    uint32_t sites_len = 0, groups = 0;
+    uint64_t scanned = 0, saved = 0;
+
+    if ( !dedup.running )
+        return;
+    pthread_join(dedup.thread, NULL);
+    dedup.running = 0;
+
+    qsort(dedup.blocks, dedup.len, sizeof(Dedup_Block), dedup_block_cmp);
+
+    printf(" size(B)    │ copies │ saved(B)     │ first site                 │ content\n");
+    printf("────────────┼────────┼──────────────┼────────────────────────────┼──────────────────\n");
+    for ( uint32_t i = 0, next; i < dedup.len; i = next ) {
+        Dedup_Block * first = &dedup.blocks[i];
+        for ( next = i + 1; next < dedup.len; next++ )
+            if ( dedup.blocks[next].size != first->size || dedup.blocks[next].hash != first->hash
+                 || dedup.blocks[next].gone != first->gone )
+                break;
+        if ( first->gone )
+            continue;
+
+        uint32_t copies = next - i;
+        scanned += (uint64_t)copies * first->size;
+        if ( copies < 2 || !first->size )
+            continue;
+
+        for ( uint32_t c = i + 1; c < next; c++ ) {
+            Dedup_Block * block = &dedup.blocks[c];
+            uint32_t s;
+            for ( s = 0; s < sites_len; s++ )
+                if ( sites[s].line_number == block->line_number && sites[s].file_name == block->file_name )
+                    break;
+            if ( s == sites_len )
+                sites[sites_len++] = (Dedup_Site){ block->file_name, block->line_number, 0, 0 };
+            sites[s].copies++;
+            sites[s].saved += block->size;
+        }
+
+        saved += (uint64_t)(copies - 1) * first->size;
+        if ( !top || groups++ < top ) {
+            char where[64];
+            snprintf(where, sizeof(where), "%s:%u", first->file_name, first->line_number);
+            printf(" %-10zu │ %-6u │ %-12llu │ %-26s │ %s\n", first->size, copies
+                   ,(unsigned long long)(copies - 1) * first->size, where, first->preview);
+        }
+    }
+    printf("────────────┴────────┴──────────────┴────────────────────────────┴──────────────────\n");
+
+    qsort(sites, sites_len, sizeof(Dedup_Site), dedup_site_cmp);
+    printf(" file             │ line     │ copies   │ saved(B)\n");
+    printf("──────────────────┼──────────┼──────────┼──────────────\n");
+    for ( uint32_t s = 0; s < sites_len; s++ )
+        printf(" %-16s │ %-8u │ %-8u │ %llu\n", sites[s].file_name, sites[s].line_number
+               ,sites[s].copies, (unsigned long long)sites[s].saved);
+    printf("──────────────────┴──────────┴──────────┴──────────────\n");
+    printf(" INTERNING SAVES : %llu of %llu B scanned in %.2f ms\n"
+           ,(unsigned long long)saved, (unsigned long long)scanned, (double)dedup.ns / 1e6);
+}
@@ -0,0 +1,302 @@
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ABYSS_C
+#include "../inc/abyss.h"
+#include "../inc/abyss_internal.h"
+
+#define BACKEND_HEADER 16       /* keeps blocks 16 byte aligned */
+#define POOL_CLASSES   9        /* 16 B .. 4 KiB */
+#define POOL_SLAB      (64<<10)
+#define POOL_LARGE     0xffffffffu
+#define ARENA_CHUNK    (1<<20)
+#define BACKEND_MAGIC  0xab755ba5u
+
+/* libc */
+
+static void * libc_alloc(size_t size)                 { return malloc(size); }
+static void * libc_zalloc(size_t nitems, size_t size) { return calloc(nitems, size); }
+static void * libc_resize(void * ptr, size_t size)    { return realloc(ptr, size); }
+static void   libc_release(void * ptr)                { free(ptr); }
+
+const Abyss_Backend abyss_backend_libc = { "libc", libc_alloc, libc_zalloc, libc_resize, libc_release };
+
+/* pool and arena blocks start after a header. magic sits where glibc
+ * keeps the high half of the chunk size, which is 0 below 4 GiB, so a
+ * pointer from libc (getline, strdup, unwrapped code) never carries it */
+
+typedef struct {
+    uint64_t size;
+    uint32_t class;
+    uint32_t magic;
+} Backend_Header;
+
+static Backend_Header * backend_header(const void * ptr)
+{
+    return (Backend_Header *)((uint8_t *)ptr - BACKEND_HEADER);
+}
+
+/* 1 when ptr may be handed to backend. libc and loaded backends cannot
+ * tell their blocks apart, so they take everything. for a libc pointer
+ * the read lands in the allocator's chunk header, which address
+ * sanitizer would report */
+__attribute__((no_sanitize_address))
+int abyss_backend_owns(const Abyss_Backend * backend, const void * ptr)
+{
+    if ( backend != &abyss_backend_pool && backend != &abyss_backend_arena )
+        return 1;
+    const uint32_t * magic = (const uint32_t *)((const uint8_t *)ptr - BACKEND_HEADER
+                                                + offsetof(Backend_Header, magic));
+    return *magic == BACKEND_MAGIC;
+}
+
+/* pool: power of two size classes carved from slabs, freed blocks go to a
+ * per-class list and are never returned. the header keeps the class, or
+ * the size for blocks past the largest class */
+
+typedef struct Pool_Block {
+    struct Pool_Block * next;
+} Pool_Block;
+
+static Pool_Block * pool_free[POOL_CLASSES];
+static int pool_lock;
+
+static uint32_t pool_class(size_t size)
+{
+    uint32_t class = 0;
+    while ( class < POOL_CLASSES && ((size_t)16 << class) < size )
+        class++;
+    return class;
+}
+
+static void * pool_alloc(size_t size)
+{
+    uint32_t class = pool_class(size);
+    Backend_Header * header;
+
+    if ( class == POOL_CLASSES ) {
+        header = malloc(BACKEND_HEADER + size);
+        if ( !header )
+            return NULL;
+        header->class = POOL_LARGE;
+        header->size = size;
+        header->magic = BACKEND_MAGIC;
+        return (uint8_t *)header + BACKEND_HEADER;
+    }
+
+    while ( __atomic_exchange_n(&pool_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+    if ( !pool_free[class] ) {
+        size_t stride = BACKEND_HEADER + ((size_t)16 << class);
+        uint8_t * slab = malloc(POOL_SLAB);
+        for ( size_t off = 0; slab && off + stride <= POOL_SLAB; off += stride ) {
+            Pool_Block * block = (Pool_Block *)(slab + off + BACKEND_HEADER);
+            ((Backend_Header *)(slab + off))->class = class;
+            ((Backend_Header *)(slab + off))->magic = BACKEND_MAGIC;
+            block->next = pool_free[class];
+            pool_free[class] = block;
+        }
+    }
+    Pool_Block * block = pool_free[class];
+    if ( block )
+        pool_free[class] = block->next;
+    __atomic_store_n(&pool_lock, 0, __ATOMIC_RELEASE);
+    return block;
+}
+
+static size_t pool_size(void * ptr)
+{
+    Backend_Header * header = backend_header(ptr);
+    return header->class == POOL_LARGE ? header->size : (size_t)16 << header->class;
+}
+
+static void pool_release(void * ptr)
+{
+    if ( !ptr )
+        return;
+
+    Backend_Header * header = backend_header(ptr);
+    if ( header->class == POOL_LARGE ) {
+        free(header);
+        return;
+    }
+    /* not a pool block, leaking it beats corrupting the free lists */
+    if ( header->class >= POOL_CLASSES )
+        return;
+
+    while ( __atomic_exchange_n(&pool_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+    ((Pool_Block *)ptr)->next = pool_free[header->class];
+    pool_free[header->class] = ptr;
+    __atomic_store_n(&pool_lock, 0, __ATOMIC_RELEASE);
+}
+
+static void * pool_zalloc(size_t nitems, size_t size)
+{
+    if ( size && nitems > SIZE_MAX / size )
+        return NULL;
+    void * ptr = pool_alloc(nitems * size);
+    if ( ptr )
+        memset(ptr, 0, nitems * size);
+    return ptr;
+}
+
+static void * pool_resize(void * ptr, size_t size)
+{
+    if ( !ptr )
+        return pool_alloc(size);
+
+    size_t old = pool_size(ptr);
+    if ( size <= old && pool_class(size) == pool_class(old) )
+        return ptr;
+
+    void * grown = pool_alloc(size);
+    if ( grown ) {
+        memcpy(grown, ptr, old < size ? old : size);
+        pool_release(ptr);
+    }
+    return grown;
+}
+
+const Abyss_Backend abyss_backend_pool = { "pool", pool_alloc, pool_zalloc, pool_resize, pool_release };
+
+/* arena: bump allocation in chunks, free only counts blocks down and the
+ * whole arena is reset once none are live */
+
+typedef struct Arena_Chunk {
+    struct Arena_Chunk * next;
+    size_t size;
+    size_t used;
+    uint8_t * last;             /* most recent block, can grow in place */
+} Arena_Chunk;
+
+static Arena_Chunk * arena;
+static uint64_t arena_live;
+static int arena_lock;
+
+static void * arena_alloc(size_t size)
+{
+    size_t need = BACKEND_HEADER + ((size + 15) & ~(size_t)15);
+
+    while ( __atomic_exchange_n(&arena_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+    if ( !arena || arena->size - arena->used < need ) {
+        size_t chunk = need > ARENA_CHUNK ? need : ARENA_CHUNK;
+        Arena_Chunk * fresh = malloc(sizeof(Arena_Chunk) + BACKEND_HEADER + chunk);
+        if ( !fresh ) {
+            __atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+            return NULL;
+        }
+        /* the header offset keeps the blocks 16 byte aligned */
+        fresh->next = arena;
+        fresh->size = chunk;
+        fresh->used = (BACKEND_HEADER - sizeof(Arena_Chunk) % BACKEND_HEADER) % BACKEND_HEADER;
+        fresh->last = NULL;
+        arena = fresh;
+    }
+
+    Backend_Header * header = (Backend_Header *)((uint8_t *)(arena + 1) + arena->used);
+    header->size = size;
+    header->magic = BACKEND_MAGIC;
+    arena->used += need;
+    arena->last = (uint8_t *)header + BACKEND_HEADER;
+    arena_live++;
+    void * ptr = arena->last;
+    __atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+    return ptr;
+}
+
+static void arena_release(void * ptr)
+{
+    if ( !ptr )
+        return;
+
+    while ( __atomic_exchange_n(&arena_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+    if ( !--arena_live ) {
+        while ( arena ) {
+            Arena_Chunk * next = arena->next;
+            free(arena);
+            arena = next;
+        }
+    }
+    __atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+}
+
+static void * arena_zalloc(size_t nitems, size_t size)
+{
+    if ( size && nitems > SIZE_MAX / size )
+        return NULL;
+    void * ptr = arena_alloc(nitems * size);
+    if ( ptr )
+        memset(ptr, 0, nitems * size);
+    return ptr;
+}
+
+static void * arena_resize(void * ptr, size_t size)
+{
+    if ( !ptr )
+        return arena_alloc(size);
+
+    Backend_Header * header = backend_header(ptr);
+    size_t old = header->size;
+
+    /* the last block of the current chunk grows in place */
+    while ( __atomic_exchange_n(&arena_lock, 1, __ATOMIC_ACQUIRE) )
+        ;
+    if ( arena && arena->last == ptr ) {
+        size_t old_need = (old + 15) & ~(size_t)15, need = (size + 15) & ~(size_t)15;
+        if ( need <= old_need || arena->size - arena->used >= need - old_need ) {
+            arena->used = arena->used - old_need + need;
+            header->size = size;
+            __atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+            return ptr;
+        }
+    }
+    __atomic_store_n(&arena_lock, 0, __ATOMIC_RELEASE);
+
+    void * grown = arena_alloc(size);
+    if ( grown ) {
+        memcpy(grown, ptr, old < size ? old : size);
+        arena_release(ptr);
+    }
+    return grown;
+}
+
+const Abyss_Backend abyss_backend_arena = { "arena", arena_alloc, arena_zalloc, arena_resize, arena_release };
+
+/* ABYSS_BACKEND=libc|pool|arena, or a path to a shared object exporting
+ * `const Abyss_Backend abyss_backend`. read before main so no block is
+ * allocated by another backend */
+__attribute__((constructor))
+static void backend_from_env()
+{
+    static const Abyss_Backend * builtins[] = { &abyss_backend_libc, &abyss_backend_pool, &abyss_backend_arena };
+    const char * name = getenv("ABYSS_BACKEND");
+
+    if ( !name || !*name )
+        return;
+
+    for ( uint32_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++ ) {
+        if ( !strcmp(name, builtins[i]->name) ) {
+            abyss_set_backend(builtins[i]);
+            return;
+        }
+    }
+
+    void * lib = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+    const Abyss_Backend * loaded = lib ? dlsym(lib, "abyss_backend") : NULL;
+    const char * reason = NULL;
+    if ( !lib )
+        reason = dlerror();
+    else if ( !loaded )
+        reason = "no abyss_backend symbol";
+    else if ( abyss_set_backend(loaded) )
+        reason = "rejected by abyss_set_backend, a function is missing or blocks are live";
+    if ( reason )
+        fprintf(stderr, "abyss: cannot use backend %s (%s), staying on libc\n", name, reason);
+}
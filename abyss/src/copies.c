@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define ABYSS_C
+#include "../inc/abyss.h"
+#include "../inc/abyss_internal.h"
+
+#define COPY_SITES   512        /* power of two */
+#define COPY_BUCKETS 40         /* log2(bytes) */
+
+static const char * copy_calls[] = { "memcpy", "memmove", "memset", "strdup" };
+
+typedef struct {
+    char * file_name;
+    uint32_t line_number;
+    uint32_t call;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t hist[COPY_BUCKETS];
+} Copy_Site;
+
+static Copy_Site copy_sites[COPY_SITES];
+static uint64_t copy_start_ns;
+static int copy_lock;
+
+static uint64_t copy_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static Copy_Site * copy_site(uint32_t call, char * file_name, uint32_t line_number)
+{
+    uint32_t hash = ((uint32_t)((uintptr_t)file_name >> 3) ^ line_number * 4u ^ call) * 2654435761u;
+
+    for ( uint32_t probe = 0; probe < COPY_SITES; probe++ ) {
+        Copy_Site * site = &copy_sites[(hash + probe) & (COPY_SITES - 1)];
+        char * key = __atomic_load_n(&site->file_name, __ATOMIC_ACQUIRE);
+
+        if ( key == file_name && site->line_number == line_number && site->call == call )
+            return site;
+        if ( key )
+            continue;
+
+        while ( __atomic_exchange_n(&copy_lock, 1, __ATOMIC_ACQUIRE) )
+            ;
+        if ( !copy_start_ns )
+            copy_start_ns = copy_now_ns();
+        if ( !site->file_name ) {
+            site->line_number = line_number;
+            site->call = call;
+            __atomic_store_n(&site->file_name, file_name, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&copy_lock, 0, __ATOMIC_RELEASE);
+        if ( site->file_name == file_name && site->line_number == line_number && site->call == call )
+            return site;
+    }
+    return NULL;
+}
+
+static void copy_record(uint32_t call, size_t n, char * file_name, uint32_t line_number)
+{
+    Copy_Site * site = copy_site(call, file_name, line_number);
+    if ( !site )
+        return;
+
+    uint32_t bucket = abyss_log2_bucket(n, COPY_BUCKETS);
+
+    __atomic_fetch_add(&site->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->bytes, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+void * abyss_memcpy(void * dest, const void * src, size_t n, char * file_name, uint32_t line_number)
+{
+    copy_record(0, n, file_name, line_number);
+    return memcpy(dest, src, n);
+}
+
+void * abyss_memmove(void * dest, const void * src, size_t n, char * file_name, uint32_t line_number)
+{
+    copy_record(1, n, file_name, line_number);
+    return memmove(dest, src, n);
+}
+
+void * abyss_memset(void * dest, int c, size_t n, char * file_name, uint32_t line_number)
+{
+    copy_record(2, n, file_name, line_number);
+    return memset(dest, c, n);
+}
+
+/* goes through abyss_malloc so the copy is logged like any other block */
+char * abyss_strdup(const char * s, char * file_name, uint32_t line_number)
+{
+    size_t n = strlen(s) + 1;
+    char * dup = abyss_malloc(n, file_name, line_number);
+
+    copy_record(3, n, file_name, line_number);
+    if ( dup )
+        memcpy(dup, s, n);
+    return dup;
+}
+
+static int copy_cmp(const void * a, const void * b)
+{
+    uint64_t ba = (*(Copy_Site * const *)a)->bytes, bb = (*(Copy_Site * const *)b)->bytes;
+    return (ba < bb) - (ba > bb);
+}
+
+/* sites ranked by bytes moved per second of run time, the top ones are
+ * where zero-copy or move semantics pay off */
+void abyss_copies_print(uint32_t top)
+{
+    static Copy_Site * order[COPY_SITES];
+    uint32_t len = 0;
+    uint64_t total = 0;
+    double seconds = copy_start_ns ? (double)(copy_now_ns() - copy_start_ns) / 1e9 : 0.0;
+
+    for ( uint32_t i = 0; i < COPY_SITES; i++ ) {
+        if ( copy_sites[i].file_name ) {
+            order[len++] = &copy_sites[i];
+            total += copy_sites[i].bytes;
+        }
+    }
+    qsort(order, len, sizeof(Copy_Site *), copy_cmp);
+
+    printf(" call     │ file             │ line     │ calls      │ bytes        │ MB/s       │ share  │ size p50   │ size p99\n");
+    printf("──────────┼──────────────────┼──────────┼────────────┼──────────────┼────────────┼────────┼────────────┼──────────\n");
+    for ( uint32_t i = 0; i < len && (!top || i < top); i++ ) {
+        Copy_Site * site = order[i];
+        printf(" %-8s │ %-16s │ %-8u │ %-10llu │ %-12llu │ %-10.2f │ %5.1f%% │ %-10llu │ %llu\n"
+               ,copy_calls[site->call], site->file_name, site->line_number
+               ,(unsigned long long)site->calls, (unsigned long long)site->bytes
+               ,seconds > 0.0 ? (double)site->bytes / seconds / 1e6 : 0.0
+               ,total ? (double)site->bytes * 100.0 / total : 0.0
+               ,(unsigned long long)abyss_log2_percentile(site->hist, COPY_BUCKETS, site->calls, 0.50)
+               ,(unsigned long long)abyss_log2_percentile(site->hist, COPY_BUCKETS, site->calls, 0.99));
+    }
+    printf("──────────┴──────────────────┴──────────┴────────────┴──────────────┴────────────┴────────┴────────────┴──────────\n");
+    printf(" TOTAL :          %llu bytes in %.3f s\n", (unsigned long long)total, seconds);
+}
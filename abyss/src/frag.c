@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define ABYSS_C
+#include "../inc/abyss.h"
+#include "../inc/abyss_internal.h"
+
+#define FRAG_PGM_MAX (1<<22)    /* pixels, wider spans average several pages */
+
+typedef struct {
+    uintptr_t page;             /* page number */
+    uint64_t count;             /* run of pages with the same occupancy */
+    uint64_t live;              /* live bytes per page */
+} Frag_Run;
+
+typedef struct {
+    char * file_name;
+    uint32_t line_number;
+    uint32_t pages;             /* distinct partial pages */
+    uintptr_t last_page;        /* last one counted, + 1 (0 = none) */
+    double pinned;
+} Frag_Site;
+
+static int frag_entry_cmp(const void * a, const void * b)
+{
+    uintptr_t pa = (uintptr_t)(*(Meta_Ptr * const *)a)->address;
+    uintptr_t pb = (uintptr_t)(*(Meta_Ptr * const *)b)->address;
+    return (pa > pb) - (pa < pb);
+}
+
+static int frag_site_cmp(const void * a, const void * b)
+{
+    double pa = ((const Frag_Site *)a)->pinned, pb = ((const Frag_Site *)b)->pinned;
+    return (pa < pb) - (pa > pb);
+}
+
+static Frag_Run * frag_find(Frag_Run * runs, uint32_t len, uintptr_t page)
+{
+    uint32_t lo = 0, hi = len;
+    while ( lo < hi ) {
+        uint32_t mid = (lo + hi) / 2;
+        if ( runs[mid].page + runs[mid].count <= page )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return &runs[lo];
+}
+
+/* adds [page, page + count) with live bytes each, merging a page shared
+ * with the previous block */
+static void frag_add(Frag_Run * runs, uint32_t * len, uintptr_t page, uint64_t count, uint64_t live)
+{
+    if ( *len && runs[*len - 1].count == 1 && runs[*len - 1].page == page && count == 1 ) {
+        runs[*len - 1].live += live;
+        return;
+    }
+    runs[(*len)++] = (Frag_Run){ page, count, live };
+}
+
+static char frag_shade(uint64_t live, size_t page)
+{
+    static const char shades[] = ".:-=+*%#";
+    uint64_t level = live * 7 / page;
+    return shades[level < 7 ? level : 7];
+}
+
+/* pages in address order with each gap between runs folded to one
+ * black pixel, several pages averaged per pixel past FRAG_PGM_MAX */
+static void frag_pgm(const char * path, Frag_Run * runs, uint32_t len, size_t page, uint32_t width)
+{
+    uint64_t total = 0;
+    for ( uint32_t r = 0; r < len; r++ )
+        total += runs[r].count + (r && runs[r].page != runs[r - 1].page + runs[r - 1].count);
+
+    uint64_t scale = (total + FRAG_PGM_MAX - 1) / FRAG_PGM_MAX;
+    uint64_t pixels = (total + scale - 1) / scale, height = (pixels + width - 1) / width;
+
+    uint8_t * image = calloc(width * height, 1);
+    FILE * out = image ? fopen(path, "wb") : NULL;
+    if ( !out ) {
+        free(image);
+        return;
+    }
+
+    uint64_t cursor = 0;
+    for ( uint32_t r = 0; r < len; r++ ) {
+        if ( r && runs[r].page != runs[r - 1].page + runs[r - 1].count )
+            cursor++;
+        uint32_t shade = (32 + (uint32_t)(runs[r].live * 223 / page)) / (uint32_t)scale;
+        for ( uint64_t p = 0; p < runs[r].count; p++, cursor++ ) {
+            uint8_t * pixel = &image[cursor / scale];
+            *pixel = *pixel + shade > 255 ? 255 : *pixel + shade;
+        }
+    }
+
+    fprintf(out, "P5\n%u %llu\n255\n", width, (unsigned long long)height);
+    fwrite(image, 1, width * height, out);
+    fclose(out);
+    free(image);
+}
+
+void abyss_frag_print(uint32_t width, const char * pgm_path)
+{
+    static Meta_Ptr log[ARR_SIZE];
+    static Meta_Ptr * order[ARR_SIZE];
+    static Frag_Run runs[3 * (ARR_SIZE)];
+    static Frag_Site sites[ARR_SIZE];
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint32_t len = 0, sites_len = 0, log_len = abyss_log_snapshot(log);
+
+    width = width ? width : 64;
+    for ( uint32_t i = 0; i < log_len; i++ )
+        order[i] = &log[i];
+    qsort(order, log_len, sizeof(Meta_Ptr *), frag_entry_cmp);
+
+    /* each block is a head page, a run of full pages and a tail page */
+    for ( uint32_t i = 0; i < log_len; i++ ) {
+        uintptr_t start = (uintptr_t)order[i]->address, end = start + order[i]->size;
+        if ( !order[i]->size )
+            continue;
+        uintptr_t first = start / page, last = (end - 1) / page;
+
+        if ( first == last ) {
+            frag_add(runs, &len, first, 1, end - start);
+            continue;
+        }
+        frag_add(runs, &len, first, 1, (first + 1) * page - start);
+        if ( last > first + 1 )
+            frag_add(runs, &len, first + 1, last - first - 1, page);
+        frag_add(runs, &len, last, 1, end - last * page);
+    }
+    if ( !len ) {
+        printf(" no logged blocks\n");
+        return;
+    }
+
+    /* a partly live page pins page - live bytes, shared by its owners
+     * in proportion to what each keeps there */
+    for ( uint32_t i = 0; i < log_len; i++ ) {
+        uintptr_t start = (uintptr_t)order[i]->address, end = start + order[i]->size;
+        if ( !order[i]->size )
+            continue;
+        uintptr_t ends[2] = { start / page, (end - 1) / page };
+        uintptr_t partial[2];
+        double pinned = 0.0;
+        uint32_t pages = 0;
+
+        for ( int e = 0; e < (ends[0] == ends[1] ? 1 : 2); e++ ) {
+            Frag_Run * run = frag_find(runs, len, ends[e]);
+            if ( run->live >= page )
+                continue;
+            uintptr_t from = ends[e] * page > start ? ends[e] * page : start;
+            uintptr_t to = (ends[e] + 1) * page < end ? (ends[e] + 1) * page : end;
+            pinned += (double)(page - run->live) * (double)(to - from) / (double)run->live;
+            partial[pages++] = ends[e];
+        }
+        if ( !pages )
+            continue;
+
+        uint32_t s;
+        for ( s = 0; s < sites_len; s++ )
+            if ( sites[s].line_number == order[i]->line_number && sites[s].file_name == order[i]->file_name )
+                break;
+        if ( s == sites_len )
+            sites[sites_len++] = (Frag_Site){ order[i]->file_name, order[i]->line_number, 0, 0, 0.0 };
+
+        /* blocks come in address order, so a page the site shares between
+         * two of its blocks is the one it counted last */
+        for ( uint32_t p = 0; p < pages; p++ ) {
+            if ( sites[s].last_page == partial[p] + 1 )
+                continue;
+            sites[s].last_page = partial[p] + 1;
+            sites[s].pages++;
+        }
+        sites[s].pinned += pinned;
+    }
+
+    uint64_t pages = 0, live = 0, partial = 0, sparse = 0;
+    for ( uint32_t r = 0; r < len; r++ ) {
+        pages += runs[r].count;
+        live += runs[r].count * runs[r].live;
+        partial += runs[r].live < page;
+        sparse += runs[r].live < page / 4;
+    }
+
+    printf(" %llu pages │ %llu B spanned │ %llu B live │ %.1f%% occupied │ %llu partial │ %llu under 25%%\n"
+           ,(unsigned long long)pages, (unsigned long long)(pages * page), (unsigned long long)live
+           ,(double)live * 100.0 / (double)(pages * page)
+           ,(unsigned long long)partial, (unsigned long long)sparse);
+
+    qsort(sites, sites_len, sizeof(Frag_Site), frag_site_cmp);
+    printf(" file             │ line     │ partial pages │ pinned(B)\n");
+    printf("──────────────────┼──────────┼───────────────┼──────────────\n");
+    for ( uint32_t s = 0; s < sites_len; s++ )
+        printf(" %-16s │ %-8u │ %-13u │ %.0f\n", sites[s].file_name, sites[s].line_number
+               ,sites[s].pages, sites[s].pinned);
+    printf("──────────────────┴──────────┴───────────────┴──────────────\n");
+
+    /* one character per page in address order, | marks a gap and long
+     * full runs are folded */
+    printf(" map: . under 1/8 live ... # full, | gap\n ");
+    uint32_t column = 0;
+    for ( uint32_t r = 0; r < len; r++ ) {
+        char cell[32];
+        int cells = 0;
+
+        if ( r && runs[r].page != runs[r - 1].page + runs[r - 1].count )
+            cells += snprintf(cell + cells, sizeof(cell) - cells, "|");
+        if ( runs[r].count > 8 )
+            cells += snprintf(cell + cells, sizeof(cell) - cells, "#(%llu)", (unsigned long long)runs[r].count);
+        else
+            for ( uint64_t p = 0; p < runs[r].count; p++ )
+                cell[cells++] = frag_shade(runs[r].live, page);
+        cell[cells] = '\0';
+
+        if ( column + cells > width ) {
+            printf("\n ");
+            column = 0;
+        }
+        printf("%s", cell);
+        column += cells;
+    }
+    printf("\n");
+
+    if ( pgm_path )
+        frag_pgm(pgm_path, runs, len, page, width);
+}
@@ -0,0 +1,250 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define ABYSS_C
+#include "../inc/abyss.h"
+#include "../inc/abyss_internal.h"
+
+#define RECYCLE_SITES 256       /* power of two */
+#define RECYCLE_HOT   16        /* sites that get a cache */
+#define RECYCLE_AFTER 1024      /* same-size allocations before a site is hot */
+#define RECYCLE_DEPTH 32
+#define RECYCLE_BYTES (64<<10)  /* per cache and thread */
+#define RECYCLE_IDLE  4096      /* wrapped calls per thread between trims */
+#define RECYCLE_CLAIM 0xffffffffu /* site->cache while a thread claims one */
+
+typedef struct {
+    char * file_name;
+    uint32_t line_number;
+    uint32_t cache;             /* 1 + index of its per-thread cache, 0 if cold */
+    size_t size;
+    int variable;               /* saw more than one size, never cached */
+    int refused;                /* hot after every cache was taken */
+    uint64_t allocs;
+    uint64_t hits;
+} Recycle_Site;
+
+typedef struct {
+    void * blocks[RECYCLE_DEPTH];
+    uint32_t len;
+    uint32_t used;              /* touched since the last trim */
+} Recycle_Cache;
+
+static Recycle_Site recycle_sites[RECYCLE_SITES];
+static Recycle_Site * recycle_owners[RECYCLE_HOT];     /* site of each cache */
+static uint32_t recycle_hot;
+int abyss_recycle_on;
+static int recycle_lock;
+
+static _Thread_local Recycle_Cache recycle_caches[RECYCLE_HOT];
+static _Thread_local uint32_t recycle_calls;
+static _Thread_local int recycle_keyed;
+
+/* the key destructor gives back an exiting thread's caches */
+static pthread_key_t recycle_key;
+static pthread_once_t recycle_once = PTHREAD_ONCE_INIT;
+
+void abyss_recycle(int enable)
+{
+    abyss_recycle_on = enable;
+    if ( !enable )
+        abyss_recycle_flush();
+}
+
+static void recycle_drain(Recycle_Cache * cache, uint32_t keep)
+{
+    while ( cache->len > keep )
+        abyss_backend_release(cache->blocks[--cache->len]);
+}
+
+void abyss_recycle_flush()
+{
+    for ( uint32_t c = 0; c < RECYCLE_HOT; c++ )
+        recycle_drain(&recycle_caches[c], 0);
+}
+
+static void recycle_thread_exit(void * arg)
+{
+    (void)arg;
+    abyss_recycle_flush();
+}
+
+static void recycle_key_create()
+{
+    pthread_key_create(&recycle_key, recycle_thread_exit);
+}
+
+/* the first time a thread parks or takes a block, so its caches are
+ * flushed when it exits */
+static void recycle_register()
+{
+    if ( recycle_keyed )
+        return;
+    pthread_once(&recycle_once, recycle_key_create);
+    pthread_setspecific(recycle_key, &recycle_keyed);
+    recycle_keyed = 1;
+}
+
+/* cache index of a hot site, 0 while cold or being claimed */
+static uint32_t recycle_cache_of(Recycle_Site * site)
+{
+    uint32_t cache = __atomic_load_n(&site->cache, __ATOMIC_ACQUIRE);
+    return cache == RECYCLE_CLAIM ? 0 : cache;
+}
+
+/* a site takes a cache by moving its slot from 0 to RECYCLE_CLAIM, so
+ * two threads cannot give one site two caches. the loser returns 0 and
+ * uses the winner's cache on a later call */
+static uint32_t recycle_claim(Recycle_Site * site)
+{
+    uint32_t expected = 0;
+    if ( !__atomic_compare_exchange_n(&site->cache, &expected, RECYCLE_CLAIM, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+        return 0;
+
+    /* claim a cache only while one is left, the count never passes
+     * RECYCLE_HOT */
+    uint32_t hot = __atomic_load_n(&recycle_hot, __ATOMIC_RELAXED);
+    do {
+        if ( hot >= RECYCLE_HOT ) {
+            __atomic_store_n(&site->refused, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&site->cache, 0, __ATOMIC_RELEASE);
+            return 0;
+        }
+    } while ( !__atomic_compare_exchange_n(&recycle_hot, &hot, hot + 1, 0,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+
+    __atomic_store_n(&recycle_owners[hot], site, __ATOMIC_RELEASE);
+    __atomic_store_n(&site->cache, hot + 1, __ATOMIC_RELEASE);
+    return hot + 1;
+}
+
+/* open addressing on the site key, NULL when the table is full */
+static Recycle_Site * recycle_site(char * file_name, uint32_t line_number)
+{
+    uint32_t hash = (uint32_t)((uintptr_t)file_name >> 3) * 2654435761u ^ line_number;
+
+    for ( uint32_t probe = 0; probe < RECYCLE_SITES; probe++ ) {
+        Recycle_Site * site = &recycle_sites[(hash + probe) & (RECYCLE_SITES - 1)];
+        char * key = __atomic_load_n(&site->file_name, __ATOMIC_ACQUIRE);
+
+        if ( key == file_name && site->line_number == line_number )
+            return site;
+        if ( key )
+            continue;
+
+        while ( __atomic_exchange_n(&recycle_lock, 1, __ATOMIC_ACQUIRE) )
+            ;
+        if ( !site->file_name ) {
+            site->line_number = line_number;
+            __atomic_store_n(&site->file_name, file_name, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&recycle_lock, 0, __ATOMIC_RELEASE);
+        if ( site->file_name == file_name && site->line_number == line_number )
+            return site;
+    }
+    return NULL;
+}
+
+/* every RECYCLE_IDLE mallocs and frees, caches left unused since the last trim give
+ * back half their blocks, caches of sites that went variable all of them */
+static void recycle_trim()
+{
+    if ( ++recycle_calls % RECYCLE_IDLE )
+        return;
+
+    for ( uint32_t c = 0; c < RECYCLE_HOT; c++ ) {
+        Recycle_Cache * cache = &recycle_caches[c];
+        Recycle_Site * owner = __atomic_load_n(&recycle_owners[c], __ATOMIC_ACQUIRE);
+        if ( owner && __atomic_load_n(&owner->variable, __ATOMIC_ACQUIRE) )
+            recycle_drain(cache, 0);
+        else if ( !cache->used )
+            recycle_drain(cache, cache->len / 2);
+        cache->used = 0;
+    }
+}
+
+void * abyss_recycle_get(size_t size, char * file_name, uint32_t line_number)
+{
+    Recycle_Site * site = recycle_site(file_name, line_number);
+
+    recycle_trim();
+    if ( !site )
+        return NULL;
+
+    /* a thread racing the first allocation may read size 0 and mark the
+     * site variable, which only costs the site its cache */
+    uint64_t allocs = __atomic_add_fetch(&site->allocs, 1, __ATOMIC_RELAXED);
+    if ( allocs == 1 )
+        __atomic_store_n(&site->size, size, __ATOMIC_RELEASE);
+    else if ( __atomic_load_n(&site->size, __ATOMIC_ACQUIRE) != size
+              && !__atomic_load_n(&site->variable, __ATOMIC_RELAXED) ) {
+        /* the cached blocks are site->size bytes and must never serve
+         * another size. this thread's go back now, other threads' at
+         * their next trim or exit */
+        __atomic_store_n(&site->variable, 1, __ATOMIC_RELEASE);
+        uint32_t index = recycle_cache_of(site);
+        if ( index )
+            recycle_drain(&recycle_caches[index - 1], 0);
+    }
+    if ( __atomic_load_n(&site->variable, __ATOMIC_ACQUIRE) )
+        return NULL;
+
+    uint32_t index = recycle_cache_of(site);
+    if ( !index ) {
+        if ( __atomic_load_n(&site->refused, __ATOMIC_RELAXED) || allocs < RECYCLE_AFTER || size > RECYCLE_BYTES )
+            return NULL;
+        if ( !(index = recycle_claim(site)) )
+            return NULL;
+    }
+    recycle_register();
+
+    Recycle_Cache * cache = &recycle_caches[index - 1];
+    cache->used = 1;
+    if ( !cache->len )
+        return NULL;
+
+    __atomic_add_fetch(&site->hits, 1, __ATOMIC_RELAXED);
+    return cache->blocks[--cache->len];
+}
+
+/* 1 when the block was kept for reuse */
+int abyss_recycle_put(void * ptr, size_t size, char * file_name, uint32_t line_number)
+{
+    Recycle_Site * site = recycle_site(file_name, line_number);
+    uint32_t index = site ? recycle_cache_of(site) : 0;
+
+    /* frees count towards the trim too, a thread that only frees still
+     * gives back idle blocks */
+    recycle_trim();
+    if ( !index || __atomic_load_n(&site->variable, __ATOMIC_ACQUIRE)
+         || __atomic_load_n(&site->size, __ATOMIC_ACQUIRE) != size )
+        return 0;
+    recycle_register();
+
+    Recycle_Cache * cache = &recycle_caches[index - 1];
+    size_t depth = RECYCLE_BYTES / (size ? size : 1);
+    if ( cache->len == RECYCLE_DEPTH || cache->len >= depth )
+        return 0;
+
+    cache->used = 1;
+    cache->blocks[cache->len++] = ptr;
+    return 1;
+}
+
+void abyss_recycle_print()
+{
+    printf(" file             │ line     │ size(B)  │ allocs     │ recycled   │ hit\n");
+    printf("──────────────────┼──────────┼──────────┼────────────┼────────────┼─────────\n");
+    for ( uint32_t i = 0; i < RECYCLE_SITES; i++ ) {
+        Recycle_Site * site = &recycle_sites[i];
+        if ( !recycle_cache_of(site) )
+            continue;
+        printf(" %-16s │ %-8u │ %-8zu │ %-10llu │ %-10llu │ %6.1f%%\n"
+               ,site->file_name, site->line_number, site->size
+               ,(unsigned long long)site->allocs, (unsigned long long)site->hits
+               ,(double)site->hits * 100.0 / site->allocs);
+    }
+    printf("──────────────────┴──────────┴──────────┴────────────┴────────────┴─────────\n");
+}
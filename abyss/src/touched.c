@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ABYSS_C
+#include "../inc/abyss.h"
+#include "../inc/abyss_internal.h"
+
+typedef struct {
+    char * file_name;
+    uint32_t line_number;
+    uint32_t blocks;
+    uint64_t reserved;
+    uint64_t touched;
+} Touched_Site;
+
+/* resident bytes of the whole pages inside the block. the partial pages
+ * at either end share space with other blocks and are left out */
+static int abyss_touched_block(const Meta_Ptr * entry, size_t page, uint64_t * reserved, uint64_t * touched)
+{
+    uintptr_t start = ((uintptr_t)entry->address + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)entry->address + entry->size) & ~(page - 1);
+    unsigned char vec[256];
+
+    *reserved = *touched = 0;
+    for ( uintptr_t at = start; at < end; at += sizeof(vec) * page ) {
+        size_t len = end - at < sizeof(vec) * page ? end - at : sizeof(vec) * page;
+        if ( mincore((void *)at, len, vec) )
+            return -1;
+        for ( size_t p = 0; p < len / page; p++ )
+            *touched += (vec[p] & 1) * page;
+        *reserved += len;
+    }
+    return 0;
+}
+
+void abyss_touched_print(size_t threshold)
+{
+    static Touched_Site sites[ARR_SIZE];
+    static Meta_Ptr log[ARR_SIZE];
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint32_t len = 0, log_len = abyss_log_snapshot(log);
+
+    /* a block freed since the snapshot fails mincore once unmapped and
+     * is skipped, otherwise it reads the pages as they are now */
+    for ( uint32_t i = 0; i < log_len; i++ ) {
+        Meta_Ptr * entry = &log[i];
+        uint64_t reserved, touched;
+
+        if ( entry->size < threshold || abyss_touched_block(entry, page, &reserved, &touched) || !reserved )
+            continue;
+
+        uint32_t s;
+        for ( s = 0; s < len; s++ )
+            if ( sites[s].line_number == entry->line_number && !strcmp(sites[s].file_name, entry->file_name) )
+                break;
+        if ( s == len )
+            sites[len++] = (Touched_Site){ entry->file_name, entry->line_number, 0, 0, 0 };
+        sites[s].blocks++;
+        sites[s].reserved += reserved;
+        sites[s].touched += touched;
+    }
+
+    uint64_t reserved = 0, touched = 0;
+    printf(" file             │ line     │ blocks │ reserved(B)  │ touched(B)   │ touched\n");
+    printf("──────────────────┼──────────┼────────┼──────────────┼──────────────┼─────────\n");
+    for ( uint32_t s = 0; s < len; s++ ) {
+        printf(" %-16s │ %-8u │ %-6u │ %-12llu │ %-12llu │ %6.1f%%\n"
+               ,sites[s].file_name, sites[s].line_number, sites[s].blocks
+               ,(unsigned long long)sites[s].reserved, (unsigned long long)sites[s].touched
+               ,(double)sites[s].touched * 100.0 / sites[s].reserved);
+        reserved += sites[s].reserved;
+        touched += sites[s].touched;
+    }
+    printf("──────────────────┴──────────┴────────┴──────────────┴──────────────┴─────────\n");
+    printf(" UNTOUCHED :      %llu\n", (unsigned long long)(reserved - touched));
+    printf("──────────────────────────────────────────────────────────────────────────────\n");
+}
@@ -0,0 +1,144 @@
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../inc/abyss_persist.h"
+
+#define WORKERS_RETRIES 64      /* a worker killed mid-update leaves seq odd */
+
+typedef struct {
+    char file_name[ABYSS_PERSIST_NAME];
+    uint32_t line_number;
+    uint32_t workers;
+    uint64_t allocs;
+    uint64_t live_bytes;
+} Workers_Site;
+
+/* seqlock read of one slot, 1 when the copy may be torn */
+static int workers_read(const Abyss_Worker * slot, Abyss_Worker * out)
+{
+    for ( int retry = 0; retry < WORKERS_RETRIES; retry++ ) {
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if ( seq & 1 )
+            continue;
+        memcpy(out, slot, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ( __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq )
+            return 0;
+    }
+    memcpy(out, slot, sizeof(*out));
+    return 1;
+}
+
+static int u64_cmp(const void * a, const void * b)
+{
+    uint64_t ua = *(const uint64_t *)a, ub = *(const uint64_t *)b;
+    return (ua > ub) - (ua < ub);
+}
+
+static int site_cmp(const void * a, const void * b)
+{
+    uint64_t la = ((const Workers_Site *)a)->live_bytes, lb = ((const Workers_Site *)b)->live_bytes;
+    return (la < lb) - (la > lb);
+}
+
+static const Abyss_Worker_Site * workers_top_site(const Abyss_Worker * worker)
+{
+    const Abyss_Worker_Site * top = NULL;
+    for ( uint32_t s = 0; s < worker->sites_len && s < ABYSS_WORKER_SITES; s++ )
+        if ( !top || worker->sites[s].live_bytes > top->live_bytes )
+            top = &worker->sites[s];
+    return top;
+}
+
+void abyss_workers_report(const Abyss_Workers * image)
+{
+    static Abyss_Worker workers[ABYSS_WORKERS_MAX];
+    static Workers_Site sites[ABYSS_WORKERS_MAX * ABYSS_WORKER_SITES];
+    uint64_t lives[ABYSS_WORKERS_MAX];
+    uint32_t slots[ABYSS_WORKERS_MAX];
+    int torn[ABYSS_WORKERS_MAX];
+    uint32_t count = 0, sites_len = 0;
+
+    if ( memcmp(image->magic, ABYSS_WORKERS_MAGIC, sizeof(image->magic))
+         || image->version != ABYSS_WORKERS_VERSION || image->worker_size != sizeof(Abyss_Worker) ) {
+        fprintf(stderr, "abyss: not a version %u workers region\n", ABYSS_WORKERS_VERSION);
+        return;
+    }
+
+    for ( uint32_t w = 0; w < image->workers && w < ABYSS_WORKERS_MAX; w++ ) {
+        Abyss_Worker * worker = &workers[count];
+        torn[count] = workers_read(&image->slots[w], worker);
+        if ( !worker->pid )
+            continue;
+        slots[count] = w;
+        lives[count++] = worker->live_bytes;
+
+        for ( uint32_t s = 0; s < worker->sites_len && s < ABYSS_WORKER_SITES; s++ ) {
+            const Abyss_Worker_Site * site = &worker->sites[s];
+            uint32_t i;
+            for ( i = 0; i < sites_len; i++ )
+                if ( sites[i].line_number == site->line_number
+                     && !strncmp(sites[i].file_name, site->file_name, ABYSS_PERSIST_NAME) )
+                    break;
+            if ( i == sites_len ) {
+                memset(&sites[i], 0, sizeof(sites[i]));
+                memcpy(sites[i].file_name, site->file_name, ABYSS_PERSIST_NAME);
+                sites[i].file_name[ABYSS_PERSIST_NAME - 1] = '\0';
+                sites[i].line_number = site->line_number;
+                sites_len++;
+            }
+            sites[i].workers++;
+            sites[i].allocs += site->allocs;
+            sites[i].live_bytes += site->live_bytes;
+        }
+    }
+    if ( !count ) {
+        printf(" no workers joined\n");
+        return;
+    }
+
+    /* divergence: distance from the median beyond 3 robust sigmas (mad
+     * scaled) or a quarter of the median, whichever is larger */
+    uint64_t sorted[ABYSS_WORKERS_MAX], deviations[ABYSS_WORKERS_MAX];
+    memcpy(sorted, lives, count * sizeof(uint64_t));
+    qsort(sorted, count, sizeof(uint64_t), u64_cmp);
+    double median = (double)sorted[count / 2];
+    for ( uint32_t w = 0; w < count; w++ )
+        deviations[w] = (uint64_t)fabs((double)lives[w] - median);
+    qsort(deviations, count, sizeof(uint64_t), u64_cmp);
+    double limit = fmax(3.0 * 1.4826 * (double)deviations[count / 2], 0.25 * median);
+
+    uint64_t allocs = 0, frees = 0, live = 0;
+    printf(" slot │ pid      │ allocs     │ frees      │ live(B)      │ peak(B)      │ top site\n");
+    printf("──────┼──────────┼────────────┼────────────┼──────────────┼──────────────┼──────────────────────\n");
+    for ( uint32_t w = 0; w < count; w++ ) {
+        Abyss_Worker * worker = &workers[w];
+        const Abyss_Worker_Site * top = workers_top_site(worker);
+        char where[ABYSS_PERSIST_NAME + 16] = "-";
+        if ( top )
+            snprintf(where, sizeof(where), "%.*s:%u", ABYSS_PERSIST_NAME - 1, top->file_name, top->line_number);
+
+        printf(" %-4u │ %-8d │ %-10llu │ %-10llu │ %-12llu │ %-12llu │ %s%s%s%s\n", slots[w], worker->pid
+               ,(unsigned long long)worker->allocs, (unsigned long long)worker->frees
+               ,(unsigned long long)worker->live_bytes, (unsigned long long)worker->peak_live_bytes
+               ,where, fabs((double)worker->live_bytes - median) > limit ? " DIVERGES" : ""
+               ,kill(worker->pid, 0) ? " exited" : "", torn[w] ? " torn" : "");
+        allocs += worker->allocs;
+        frees += worker->frees;
+        live += worker->live_bytes;
+    }
+    printf("──────┴──────────┴────────────┴────────────┴──────────────┴──────────────┴──────────────────────\n");
+    printf(" TOTAL : %u workers │ %llu allocs │ %llu frees │ %llu live │ median %.0f\n", count
+           ,(unsigned long long)allocs, (unsigned long long)frees, (unsigned long long)live, median);
+
+    qsort(sites, sites_len, sizeof(Workers_Site), site_cmp);
+    printf(" file             │ line     │ workers │ allocs     │ live(B)\n");
+    printf("──────────────────┼──────────┼─────────┼────────────┼──────────────\n");
+    for ( uint32_t i = 0; i < sites_len && i < 16; i++ )
+        printf(" %-16s │ %-8u │ %-7u │ %-10llu │ %llu\n", sites[i].file_name, sites[i].line_number
+               ,sites[i].workers, (unsigned long long)sites[i].allocs, (unsigned long long)sites[i].live_bytes);
+    printf("──────────────────┴──────────┴─────────┴────────────┴──────────────\n");
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../inc/abyss.h"
+
+/* pointers libc handed out behind the wrappers are freed through them,
+ * the pool and arena backends must pass them on to libc */
+
+static int failed;
+
+#define CHECK(cond) do {                                                     \
+    if ( !(cond) ) {                                                         \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+        failed = 1;                                                          \
+    }                                                                        \
+} while ( 0 )
+
+static void foreign_free(const Abyss_Backend * backend)
+{
+    CHECK(abyss_set_backend(backend) == 0);
+
+    char * kept = malloc(256);
+    CHECK(kept != NULL);
+    if ( !kept )
+        return;
+
+    /* the parentheses skip the wrapper macros, as unwrapped code would */
+    char * foreign = (strdup)("from libc");
+    free(foreign);
+    foreign = (realloc)(NULL, 64);
+    foreign = realloc(foreign, 4096);
+    free(foreign);
+
+    /* the block from the backend is still live and usable */
+    memset(kept, 0x5a, 256);
+    char * next = malloc(256);
+    CHECK(next != NULL && next != kept);
+    CHECK(kept[255] == 0x5a);
+
+    free(next);
+    free(kept);
+    CHECK(abyss_set_backend(&abyss_backend_libc) == 0);
+}
+
+int main()
+{
+    foreign_free(&abyss_backend_arena);
+    foreign_free(&abyss_backend_pool);
+
+    printf("backend: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
@@ -0,0 +1,62 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../inc/abyss.h"
+#include "../inc/abyss_persist.h"
+
+/* persisted site counters keep moving once more blocks are live than the
+ * log holds */
+
+#define BLOCKS 1000
+
+static int failed;
+
+#define CHECK(cond) do {                                                     \
+    if ( !(cond) ) {                                                         \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+        failed = 1;                                                          \
+    }                                                                        \
+} while ( 0 )
+
+int main()
+{
+    char path[] = "/tmp/abyss_persist_XXXXXX";
+    int fd = mkstemp(path);
+    if ( fd < 0 )
+        return 1;
+    close(fd);
+
+    if ( abyss_persist(path) ) {
+        unlink(path);
+        return 1;
+    }
+
+    fd = open(path, O_RDONLY);
+    const Abyss_Persist * image = mmap(NULL, sizeof(Abyss_Persist), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    unlink(path);
+    if ( image == MAP_FAILED )
+        return 1;
+
+    static void * blocks[BLOCKS];
+    for ( int i = 0; i < BLOCKS; i++ )
+        blocks[i] = malloc(100);
+    CHECK(image->sites_len == 1);
+    CHECK(image->len == ABYSS_PERSIST_ENTRIES);
+    const Abyss_Persist_Site * site = &image->sites[0];
+    CHECK(site->allocs == BLOCKS);
+    CHECK(site->live_bytes == BLOCKS * 100);
+
+    for ( int i = BLOCKS - 1; i >= 0; i-- )
+        free(blocks[i]);
+    CHECK(site->frees == BLOCKS);
+    CHECK(site->live_bytes == 0);
+    CHECK(site->peak_live_bytes == BLOCKS * 100);
+    CHECK(image->len == 0);
+
+    printf("persist: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
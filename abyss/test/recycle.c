@@ -0,0 +1,57 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../inc/abyss.h"
+
+/* a hot 64 B site must never hand a cached block to a larger request */
+
+static int failed;
+
+#define CHECK(cond) do {                                                     \
+    if ( !(cond) ) {                                                         \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+        failed = 1;                                                          \
+    }                                                                        \
+} while ( 0 )
+
+static void * site_alloc(size_t size)
+{
+    return malloc(size);
+}
+
+int main()
+{
+    abyss_recycle(1);
+
+    /* past the hot threshold, frees park the blocks in the cache */
+    void * blocks[8];
+    for ( int round = 0; round < 256; round++ ) {
+        for ( int i = 0; i < 8; i++ )
+            blocks[i] = site_alloc(64);
+        for ( int i = 0; i < 8; i++ )
+            free(blocks[i]);
+    }
+
+    void * same = site_alloc(64);
+    CHECK(same && malloc_usable_size(same) >= 64);
+
+    void * larger = site_alloc(4096);
+    CHECK(larger && malloc_usable_size(larger) >= 4096);
+    if ( larger )
+        memset(larger, 0xab, 4096);
+
+    /* the site is variable now, 64 B requests are not served from the
+     * cache either */
+    void * again = site_alloc(64);
+    CHECK(again && malloc_usable_size(again) >= 64);
+
+    free(same);
+    free(larger);
+    free(again);
+    abyss_recycle(0);
+
+    printf("recycle: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
@@ -0,0 +1,66 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../inc/abyss.h"
+#include "../inc/abyss_persist.h"
+
+/* a worker slot keeps counting once more blocks are live than the log holds */
+
+#define BLOCKS 1000
+
+static int failed;
+
+#define CHECK(cond) do {                                                     \
+    if ( !(cond) ) {                                                         \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+        failed = 1;                                                          \
+    }                                                                        \
+} while ( 0 )
+
+int main()
+{
+    char path[] = "/tmp/abyss_workers_XXXXXX";
+    int fd = mkstemp(path);
+    if ( fd < 0 )
+        return 1;
+    close(fd);
+
+    if ( abyss_workers_create(path, 1) || abyss_workers_join(0) ) {
+        unlink(path);
+        return 1;
+    }
+
+    fd = open(path, O_RDONLY);
+    size_t size = sizeof(Abyss_Workers) + sizeof(Abyss_Worker);
+    const Abyss_Workers * image = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    unlink(path);
+    if ( image == MAP_FAILED )
+        return 1;
+    const Abyss_Worker * slot = &image->slots[0];
+
+    static void * blocks[BLOCKS];
+    for ( int i = 0; i < BLOCKS; i++ )
+        blocks[i] = malloc(100);
+    CHECK(slot->allocs == BLOCKS);
+    CHECK(slot->live_bytes == BLOCKS * 100);
+
+    for ( int i = 0; i < BLOCKS / 2; i++ )
+        free(blocks[i]);
+    CHECK(slot->frees == BLOCKS / 2);
+    CHECK(slot->live_bytes == BLOCKS / 2 * 100);
+
+    blocks[BLOCKS - 1] = realloc(blocks[BLOCKS - 1], 300);
+    CHECK(slot->live_bytes == BLOCKS / 2 * 100 + 200);
+
+    for ( int i = BLOCKS / 2; i < BLOCKS; i++ )
+        free(blocks[i]);
+    CHECK(slot->frees == BLOCKS + 1);
+    CHECK(slot->live_bytes == 0);
+
+    printf("workers: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../inc/abyss_persist.h"
+
+/* offline reader for the file written by abyss_persist. prints the sites
+ * holding the most live memory and the largest live blocks at the moment
+ * the process stopped updating it. a workers region from
+ * abyss_workers_create is mapped and reported live */
+
+static const Abyss_Persist * image;
+
+static int site_cmp(const void * a, const void * b)
+{
+    uint64_t la = image->sites[*(const uint32_t *)a].live_bytes;
+    uint64_t lb = image->sites[*(const uint32_t *)b].live_bytes;
+    return (la < lb) - (la > lb);
+}
+
+static int entry_cmp(const void * a, const void * b)
+{
+    uint64_t sa = image->entries[*(const uint32_t *)a].size;
+    uint64_t sb = image->entries[*(const uint32_t *)b].size;
+    return (sa < sb) - (sa > sb);
+}
+
+static int inspect_load(const char * path, Abyss_Persist * out)
+{
+    FILE * in = fopen(path, "rb");
+    if ( !in ) {
+        fprintf(stderr, "abyss_inspect: cannot open %s\n", path);
+        return -1;
+    }
+    size_t got = fread(out, 1, sizeof(*out), in);
+    fclose(in);
+
+    if ( got < sizeof(*out) || memcmp(out->magic, ABYSS_PERSIST_MAGIC, sizeof(out->magic)) ) {
+        fprintf(stderr, "abyss_inspect: %s is not an abyss registry\n", path);
+        return -1;
+    }
+    if ( out->version != ABYSS_PERSIST_VERSION || out->entry_size != sizeof(Abyss_Persist_Entry)
+         || out->site_size != sizeof(Abyss_Persist_Site) || out->entries_max != ABYSS_PERSIST_ENTRIES
+         || out->sites_max != ABYSS_PERSIST_SITES ) {
+        fprintf(stderr, "abyss_inspect: %s has layout version %u, this tool reads %u\n"
+                ,path, out->version, ABYSS_PERSIST_VERSION);
+        return -1;
+    }
+    if ( out->len > ABYSS_PERSIST_ENTRIES || out->sites_len > ABYSS_PERSIST_SITES ) {
+        fprintf(stderr, "abyss_inspect: %s is corrupt\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int inspect_workers(const char * path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(Abyss_Workers) ) {
+        fprintf(stderr, "abyss_inspect: cannot map %s\n", path);
+        return -1;
+    }
+    const Abyss_Workers * workers = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( workers == MAP_FAILED )
+        return -1;
+
+    if ( sizeof(Abyss_Workers) + (size_t)workers->workers * sizeof(Abyss_Worker) > (size_t)st.st_size ) {
+        fprintf(stderr, "abyss_inspect: %s is truncated\n", path);
+        return -1;
+    }
+    abyss_workers_report(workers);
+    munmap((void *)workers, st.st_size);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    static Abyss_Persist persist;
+    static uint32_t order[ABYSS_PERSIST_ENTRIES > ABYSS_PERSIST_SITES ? ABYSS_PERSIST_ENTRIES : ABYSS_PERSIST_SITES];
+
+    if ( argc < 2 ) {
+        fprintf(stderr, "usage: %s <registry file> [top]\n", argv[0]);
+        return 1;
+    }
+    uint32_t top = argc > 2 ? (uint32_t)atoi(argv[2]) : 16;
+
+    char magic[8];
+    FILE * in = fopen(argv[1], "rb");
+    if ( in ) {
+        size_t got = fread(magic, 1, sizeof(magic), in);
+        fclose(in);
+        if ( got == sizeof(magic) && !memcmp(magic, ABYSS_WORKERS_MAGIC, sizeof(magic)) )
+            return inspect_workers(argv[1]) ? 1 : 0;
+    }
+
+    if ( inspect_load(argv[1], &persist) )
+        return 1;
+    image = &persist;
+
+    uint64_t live = 0;
+    for ( uint32_t i = 0; i < persist.len; i++ )
+        live += persist.entries[i].size;
+
+    time_t last = (time_t)persist.last_time;
+    printf(" pid %d │ ran %llu s │ last update %s", persist.pid
+           ,(unsigned long long)(persist.last_time - persist.start_time), ctime(&last));
+    printf(" %u live blocks │ %llu bytes │ %llu updates\n"
+           ,persist.len, (unsigned long long)live, (unsigned long long)persist.updates);
+
+    /* a site whose live bytes sit at its peak was still growing */
+    for ( uint32_t i = 0; i < persist.sites_len; i++ )
+        order[i] = i;
+    qsort(order, persist.sites_len, sizeof(uint32_t), site_cmp);
+
+    printf(" file             │ line     │ allocs     │ frees      │ live(B)      │ peak(B)      │\n");
+    printf("──────────────────┼──────────┼────────────┼────────────┼──────────────┼──────────────┼─────────\n");
+    for ( uint32_t i = 0; i < persist.sites_len && i < top; i++ ) {
+        const Abyss_Persist_Site * site = &persist.sites[order[i]];
+        printf(" %-16s │ %-8u │ %-10llu │ %-10llu │ %-12llu │ %-12llu │ %s\n"
+               ,site->file_name, site->line_number
+               ,(unsigned long long)site->allocs, (unsigned long long)site->frees
+               ,(unsigned long long)site->live_bytes, (unsigned long long)site->peak_live_bytes
+               ,site->live_bytes && site->live_bytes == site->peak_live_bytes ? "growing" : "");
+    }
+    printf("──────────────────┴──────────┴────────────┴────────────┴──────────────┴──────────────┴─────────\n");
+
+    for ( uint32_t i = 0; i < persist.len; i++ )
+        order[i] = i;
+    qsort(order, persist.len, sizeof(uint32_t), entry_cmp);
+
+    printf(" address            │ size(B)      │ file             │ line\n");
+    printf("────────────────────┼──────────────┼──────────────────┼──────────\n");
+    for ( uint32_t i = 0; i < persist.len && i < top; i++ ) {
+        const Abyss_Persist_Entry * entry = &persist.entries[order[i]];
+        printf(" 0x%-16llx │ %-12llu │ %-16s │ %u\n", (unsigned long long)entry->address
+               ,(unsigned long long)entry->size, entry->file_name, entry->line_number);
+    }
+    printf("────────────────────┴──────────────┴──────────────────┴──────────\n");
+    return 0;
+}
@@ -1,8 +1,325 @@
 #ifndef TIMEKEEPER_H
 #define TIMEKEEPER_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "timekeeper_inline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef void (*Void_Funct_Void)();
 
 double timekeeper_benchmark_funct(Void_Funct_Void funct);
 
+uint64_t timekeeper_hist_percentile(const uint64_t * hist, double p);
+
+/* auto-tuner
+ * searches the cartesian product of params for the fastest config of funct,
+ * exhaustively when small, by successive halving otherwise. the winner is
+ * saved in a per-host cache file ($TIMEKEEPER_TUNE_CACHE or
+ * ~/.cache/timekeeper/<host>.tune) that timekeeper_tune_load reads back.
+ * both return 0 on success and -1 on failure. */
+typedef void (*Void_Funct_Config)(const int64_t * config, void * arg);
+
+typedef struct {
+    const char * name;
+    const int64_t * values;
+    uint32_t len;
+} Timekeeper_Param;
+
+int timekeeper_tune(const char * name, Void_Funct_Config funct, void * arg,
+                    const Timekeeper_Param * params, uint32_t param_count,
+                    int64_t * best_config);
+int timekeeper_tune_load(const char * name, int64_t * config, uint32_t param_count);
+int timekeeper_tune_store(const char * name, const Timekeeper_Param * params,
+                          uint32_t param_count, const int64_t * config);
+
+/* hardware counters (perf_event_open, user space only)
+ * open returns a file descriptor or -1 when the counter is unavailable */
+int      timekeeper_counter_open(uint32_t type, uint64_t config);
+void     timekeeper_counter_start(int fd);
+uint64_t timekeeper_counter_stop(int fd);
+void     timekeeper_counter_close(int fd);
+
+/* performance budgets
+ * TK_ASSERT_BUDGET(parse(buf), 20000, 0) aborts when the code retires more
+ * user-space instructions or makes more allocations than allowed.
+ * instructions come from the perf counter; without one (or with
+ * TIMEKEEPER_BUDGET_STEP set) the code runs in a forked child that is
+ * single-stepped with ptrace, which is slow and keeps its side effects in the
+ * child. allocations are counted once abyss reports them:
+ *     abyss_set_alloc_hook(timekeeper_budget_count_alloc);
+ * wrap code containing top-level commas in parentheses. */
+typedef struct {
+    int fd;                 /* instruction counter, -1 when single-stepping */
+    int pipe_fd;            /* child -> parent, in the fallback */
+    int child;              /* 1 inside the traced child */
+    int counted;            /* instructions is valid */
+    uint64_t instructions;
+    uint64_t allocs;
+    uint64_t alloc_start;
+} Timekeeper_Budget;
+
+void timekeeper_budget_count_alloc(void * ptr, size_t size);
+int  timekeeper_budget_begin(Timekeeper_Budget * budget);
+void timekeeper_budget_end(Timekeeper_Budget * budget);
+void timekeeper_budget_check(const Timekeeper_Budget * budget,
+                             uint64_t max_instructions, uint64_t max_allocs,
+                             const char * code, const char * file_name, uint32_t line_number);
+
+#define TK_ASSERT_BUDGET(code, max_instructions, max_allocs) do {             \
+    Timekeeper_Budget tk_budget_;                                             \
+    if ( timekeeper_budget_begin(&tk_budget_) ) {                             \
+        code;                                                                 \
+        timekeeper_budget_end(&tk_budget_);                                   \
+    }                                                                         \
+    timekeeper_budget_check(&tk_budget_, max_instructions, max_allocs,        \
+                            #code, __FILE__, __LINE__);                       \
+} while ( 0 )
+
+/* request-scoped spans
+ * a request lives in the calling thread between begin and end. to move it to
+ * another thread, handoff on the sender and adopt the returned pointer on
+ * the receiver; the time in between is charged to "(handoff)". the report
+ * compares the slowest 1% of the last TK_REQUEST_MAX requests with the
+ * median of every stage and names the stage behind the excess. */
+#define TK_REQUEST_MAX  (1<<13)
+#define TK_STAGE_MAX    16
+
+typedef struct Timekeeper_Request Timekeeper_Request;
+
+void timekeeper_stage_name(uint32_t stage, const char * name);
+void timekeeper_request_begin(uint64_t request_id);
+void timekeeper_request_end();
+void timekeeper_stage_begin(uint32_t stage);
+void timekeeper_stage_end();
+Timekeeper_Request * timekeeper_request_handoff();
+void timekeeper_request_adopt(Timekeeper_Request * request);
+void timekeeper_request_report();
+
+/* continuous profiling agent
+ * samples stacks on SIGPROF (process cpu time) at hz and, every period_s,
+ * writes the stack counts and the zone deltas of the period to
+ * dir/segment.NNN.tkp, rotating over max_segments files that share
+ * disk_budget bytes. zeroed fields take the defaults 19 hz, 60 s, 16 files
+ * and 16 MiB. timekeeper_agent_dump merges the segments overlapping a time
+ * window, so old profiles can be read back without reproducing anything. */
+typedef struct {
+    const char * dir;
+    uint32_t hz;
+    uint32_t period_s;
+    uint32_t max_segments;
+    uint64_t disk_budget;
+} Timekeeper_Agent_Config;
+
+int  timekeeper_agent_start(const Timekeeper_Agent_Config * config);
+void timekeeper_agent_stop();
+int  timekeeper_agent_dump(const char * dir, time_t from, time_t to, uint32_t max_segments);
+
+/* asynchronous operations
+ * begin returns a handle that end accepts from any thread; both sides are
+ * lock-free. latency histograms are kept per operation type. an operation
+ * still open when its slot comes around again (TK_ASYNC_SLOTS begins later)
+ * is counted lost, and timekeeper_async_pending lists the ones open for
+ * longer than a threshold. */
+#define TK_ASYNC_SLOTS  (1<<12)
+#define TK_ASYNC_TYPES  32
+
+typedef uint64_t Timekeeper_Async;
+
+void timekeeper_async_type(uint32_t type, const char * name);
+Timekeeper_Async timekeeper_async_begin(uint32_t type);
+void timekeeper_async_end(Timekeeper_Async handle);
+uint32_t timekeeper_async_pending(uint64_t older_than_ns);
+void timekeeper_async_print();
+
+/* event-loop ticks
+ * wrap every iteration of a loop in tick_begin/tick_end to get the tick
+ * duration and loop lag (start to start) distributions. ticks longer than
+ * the budget are recorded with the zones that consumed them; the zone
+ * breakdown assumes the zones run on the loop thread. state is per thread. */
+#define TK_TICK_SLOW    64      /* over-budget ticks kept */
+
+void timekeeper_tick_budget(uint64_t budget_ns);
+void timekeeper_tick_begin();
+void timekeeper_tick_end();
+void timekeeper_tick_print();
+
+/* benchmark input corpora
+ * the file is mmap'd read-only and benchmarks get zero-copy slices of it,
+ * one record per iteration. a corpus starts as one record; split it on a
+ * delimiter (which is stripped from the slices) or into fixed-size records.
+ * with TK_CORPUS_RANDOM every pass visits the records in a new shuffled
+ * order, otherwise in file order. */
+#define TK_CORPUS_POPULATE  1   /* fault the whole file in at open */
+#define TK_CORPUS_HUGE      2   /* ask for transparent huge pages */
+#define TK_CORPUS_RANDOM    4   /* shuffled record order */
+
+typedef struct {
+    const uint8_t * data;
+    size_t len;
+} Timekeeper_Slice;
+
+typedef struct {
+    const uint8_t * base;
+    size_t size;
+    uint64_t * offsets;         /* count + 1 record boundaries */
+    uint32_t * order;           /* shuffled indices, TK_CORPUS_RANDOM */
+    uint64_t count;
+    uint64_t cursor;
+    uint64_t seed;
+    uint32_t flags;
+    int delimiter;              /* -1 for fixed-size records */
+} Timekeeper_Corpus;
+
+typedef void (*Void_Funct_Slice)(Timekeeper_Slice slice, void * arg);
+
+int  timekeeper_corpus_open(Timekeeper_Corpus * corpus, const char * path, uint32_t flags);
+int  timekeeper_corpus_split(Timekeeper_Corpus * corpus, char delimiter);
+int  timekeeper_corpus_fixed(Timekeeper_Corpus * corpus, size_t record_size);
+Timekeeper_Slice timekeeper_corpus_next(Timekeeper_Corpus * corpus);
+void timekeeper_corpus_close(Timekeeper_Corpus * corpus);
+double timekeeper_benchmark_corpus(Timekeeper_Corpus * corpus, Void_Funct_Slice funct,
+                                   void * arg, uint64_t iterations);
+
+/* file-read benchmarks with a controlled page cache
+ * every iteration reads the whole file with the given method after putting
+ * it in the requested cache state: TK_IO_COLD evicts it with
+ * posix_fadvise(DONTNEED), TK_IO_HOT reads it once beforehand. TK_IO_DIRECT
+ * opens with O_DIRECT (block_size must be a multiple of 4096 and the file
+ * system must support it). TK_IO_BATCH issues TK_IO_BATCH_DEPTH blocks per
+ * preadv call, the batching available without io_uring. latency is per
+ * read call (per block touched for mmap). */
+#define TK_IO_COLD          1
+#define TK_IO_HOT           2
+#define TK_IO_DIRECT        4
+#define TK_IO_BATCH_DEPTH   16
+
+typedef enum {
+    TK_IO_READ,
+    TK_IO_PREAD,
+    TK_IO_MMAP,
+    TK_IO_BATCH,
+} Timekeeper_Io_Method;
+
+typedef struct {
+    uint64_t iterations;
+    uint64_t bytes;             /* per pass */
+    uint64_t calls;
+    double call_mean_ns;
+    double call_p50_ns;
+    double call_p99_ns;
+    double call_max_ns;
+    double pass_mean_ns;
+    double mb_per_s;
+    double best_mb_per_s;
+} Timekeeper_Io_Result;
+
+int  timekeeper_io_bench(const char * path, Timekeeper_Io_Method method, uint32_t flags,
+                         size_t block_size, uint32_t iterations, Timekeeper_Io_Result * result);
+void timekeeper_io_print(const char * label, const Timekeeper_Io_Result * result);
+
+/* benchmark history
+ * append adds one run to a local history file keyed by git revision
+ * ($TIMEKEEPER_REVISION or `git rev-parse`) and host profile (hostname plus
+ * cpu model). changes runs cusum binary segmentation over the runs of one
+ * benchmark on this host profile and prints the revisions where its level
+ * shifted, which catches slow creep a single baseline misses. */
+int timekeeper_history_append(const char * path, const char * bench, double value);
+int timekeeper_history_changes(const char * path, const char * bench, double threshold);
+
+/* per-thread cpu timeline
+ * a sampler thread reads /proc/self/task every interval_ns (0 = 1 ms)
+ * between start and stop, recording each thread's cpu time and state.
+ * print shows the state timeline squeezed to width columns, the load
+ * imbalance and the share of the run the busiest thread spent waiting. */
+#define TK_THREAD_MAX       64
+#define TK_THREAD_SAMPLES   4096    /* timeline samples kept per thread */
+
+int  timekeeper_threads_start(uint64_t interval_ns);
+void timekeeper_threads_stop();
+void timekeeper_threads_print(uint32_t width);
+
+/* huge page impact
+ * runs funct over a working set of size bytes backed by 4K pages
+ * (MADV_NOHUGEPAGE), transparent huge pages (MADV_HUGEPAGE) or explicit
+ * hugetlb pages, after init has faulted it in (memset when NULL). reports
+ * ns per call, dTLB read misses per call when the counter is available and
+ * how much of the buffer the kernel really backed with huge pages. */
+typedef enum {
+    TK_PAGES_4K,
+    TK_PAGES_THP,
+    TK_PAGES_HUGETLB,
+} Timekeeper_Pages;
+
+typedef struct {
+    double ns;
+    uint64_t dtlb_misses;
+    int counted;                /* dtlb_misses is valid */
+    uint64_t huge_bytes;
+} Timekeeper_Pages_Result;
+
+typedef void (*Void_Funct_Buffer)(uint8_t * buf, size_t size, void * arg);
+
+int  timekeeper_pages_bench(size_t size, Timekeeper_Pages pages,
+                            Void_Funct_Buffer init, Void_Funct_Buffer funct, void * arg,
+                            uint32_t iterations, Timekeeper_Pages_Result * result);
+void timekeeper_pages_compare(size_t size, Void_Funct_Buffer init, Void_Funct_Buffer funct,
+                              void * arg, uint32_t iterations);
+
+/* runtime-dispatched simd variants
+ * register a kernel's variants from narrowest to widest with the cpu
+ * features each needs. rank skips the ones cpuid says are unsupported,
+ * checks the rest produce byte-identical output to the first supported one
+ * on randomized inputs (kernel->fill can generate valid ones), times them
+ * and stores the fastest in the tuner cache under the kernel name. dispatch
+ * reads that back at startup, falling back to the widest supported one. */
+#define TK_SIMD_SSE42       1
+#define TK_SIMD_AVX2        2
+#define TK_SIMD_AVX512      4
+#define TK_SIMD_VARIANTS    8
+
+typedef void (*Void_Funct_Kernel)(void * out, const void * in, size_t n);
+
+typedef enum {
+    TK_VARIANT_UNTESTED,
+    TK_VARIANT_OK,
+    TK_VARIANT_UNSUPPORTED,
+    TK_VARIANT_MISMATCH,
+} Timekeeper_Variant_Status;
+
+typedef struct {
+    const char * name;
+    Void_Funct_Kernel funct;
+    uint32_t features;
+    Timekeeper_Variant_Status status;
+    double ns;                  /* fastest call over n elements */
+} Timekeeper_Variant;
+
+typedef struct {
+    const char * name;
+    size_t in_size;             /* bytes per input element */
+    size_t out_size;            /* bytes per output element */
+    void (*fill)(void * in, size_t n, uint64_t seed);
+    Timekeeper_Variant variants[TK_SIMD_VARIANTS];
+    uint32_t count;
+    uint32_t best_index;
+    Void_Funct_Kernel best;
+} Timekeeper_Kernel;
+
+uint32_t timekeeper_cpu_features();
+int  timekeeper_kernel_add(Timekeeper_Kernel * kernel, const char * name,
+                           Void_Funct_Kernel funct, uint32_t features);
+Void_Funct_Kernel timekeeper_kernel_rank(Timekeeper_Kernel * kernel, size_t n, uint32_t rounds);
+Void_Funct_Kernel timekeeper_kernel_dispatch(Timekeeper_Kernel * kernel);
+void timekeeper_kernel_print(const Timekeeper_Kernel * kernel, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // !TIMEKEEPER_H
@@ -0,0 +1,162 @@
+#ifndef TIMEKEEPER_HPP
+#define TIMEKEEPER_HPP
+
+/* c++ front end
+ *
+ *     auto r = tk::bench("sum", [&](tk::State & s) {
+ *         total += data[s.iteration() % n];
+ *         s.do_not_optimize(total);
+ *     });
+ *     tk::print(r);
+ *
+ * the body must hand its result to do_not_optimize: at -O2 a total nothing
+ * reads is dead, the loads go with it and the loop times nothing.
+ * the clock, the counter and the unroll factor are template parameters, so
+ * the measured loop has no runtime branches, and the callable is a template
+ * argument too, so it stays inlinable. captures replace the globals the
+ * Void_Funct_Void signature forces on c callers. needs c++17. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <type_traits>
+#include <utility>
+
+#include "timekeeper.h"
+
+namespace tk {
+
+namespace clock {
+
+struct monotonic {
+    static constexpr const char * unit = "ns";
+    static uint64_t now() { return timekeeper_now_ns(); }
+};
+
+struct cycles {
+    static constexpr const char * unit = "cycles";
+    static uint64_t now() { return timekeeper_cycles(); }
+};
+
+struct process_cpu {
+    static constexpr const char * unit = "cpu ns";
+    static uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+};
+
+} // namespace clock
+
+/* a counter read next to the clock, around every batch */
+namespace counter {
+
+struct none {
+    static constexpr const char * name = nullptr;
+    void start() {}
+    void stop() {}
+    uint64_t value() const { return 0; }
+};
+
+struct cycles {
+    static constexpr const char * name = "cycles";
+    uint64_t total = 0, begin = 0;
+    void start() { begin = timekeeper_cycles(); }
+    void stop() { total += timekeeper_cycles() - begin; }
+    uint64_t value() const { return total; }
+};
+
+} // namespace counter
+
+class State {
+public:
+    explicit State(uint64_t iterations) : iterations_(iterations) {}
+
+    uint64_t iteration() const { return iteration_; }
+    uint64_t iterations() const { return iterations_; }
+
+    template <class T>
+    void do_not_optimize(const T & value) { timekeeper_do_not_optimize(&value); }
+
+private:
+    template <class, class, unsigned, class>
+    friend struct Runner;
+
+    uint64_t iteration_ = 0;
+    uint64_t iterations_;
+};
+
+struct Result {
+    const char * name;
+    const char * unit;
+    const char * counter_name;
+    uint64_t iterations;
+    double mean;            /* clock units per iteration */
+    double best_batch;      /* fastest batch, per iteration */
+    double counter;         /* counter units per iteration */
+};
+
+template <class Clock, class Counter, unsigned Unroll, class F>
+struct Runner {
+    template <unsigned... I>
+    static inline void unrolled(F & f, State & s, std::integer_sequence<unsigned, I...>)
+    {
+        ((f(s), ++s.iteration_, (void)I), ...);
+    }
+
+    static Result run(const char * name, F & f, uint64_t iterations, uint32_t batches)
+    {
+        static_assert(Unroll > 0, "unroll factor must be positive");
+
+        uint64_t per_batch = iterations / batches / Unroll;
+        if ( !per_batch )
+            per_batch = 1;
+
+        State s(per_batch * Unroll * batches);
+        Counter counter;
+        uint64_t total = 0, best = UINT64_MAX;
+
+        for ( uint32_t b = 0; b < batches; b++ ) {
+            counter.start();
+            uint64_t start = Clock::now();
+            for ( uint64_t i = 0; i < per_batch; i++ )
+                unrolled(f, s, std::make_integer_sequence<unsigned, Unroll>{});
+            uint64_t elapsed = Clock::now() - start;
+            counter.stop();
+
+            total += elapsed;
+            if ( elapsed < best )
+                best = elapsed;
+        }
+
+        double n = (double)s.iterations();
+        return Result{ name, Clock::unit, Counter::name, s.iterations(),
+                       (double)total / n,
+                       (double)best / (double)(per_batch * Unroll),
+                       (double)counter.value() / n };
+    }
+};
+
+template <class Clock = clock::monotonic, class Counter = counter::none,
+          unsigned Unroll = 1, class F>
+inline Result bench(const char * name, F && f,
+                    uint64_t iterations = 1u << 20, uint32_t batches = 16)
+{
+    using Fn = std::remove_reference_t<F>;
+    return Runner<Clock, Counter, Unroll, Fn>::run(name, f, iterations, batches ? batches : 1);
+}
+
+inline void print(const Result & r)
+{
+    printf(" %-16s │ %-10llu iters │ %10.2f %s/iter │ best %10.2f",
+           r.name, (unsigned long long)r.iterations, r.mean, r.unit, r.best_batch);
+    if ( r.counter_name )
+        printf(" │ %10.2f %s/iter", r.counter, r.counter_name);
+    printf("\n");
+}
+
+} // namespace tk
+
+#endif // !TIMEKEEPER_HPP
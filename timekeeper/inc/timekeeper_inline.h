@@ -0,0 +1,198 @@
+#ifndef TIMEKEEPER_INLINE_H
+#define TIMEKEEPER_INLINE_H
+
+/* single-header timekeeper
+ * static inline timer reads, zone macros and batch loops. the measured body
+ * is pasted into the timing loop instead of being called through a pointer,
+ * so the compiler can inline and schedule it like the production code.
+ *
+ * define TIMEKEEPER_IMPLEMENTATION before including this in exactly one
+ * translation unit (the library build does it in timekeeper.c).
+ *
+ * overhead, gcc 12 -O2 on an x86-64 vm (`make bench`, see README.md). the
+ * first three are this header's code and cost the same with or without the
+ * library, the last is the library's out-of-line call for comparison:
+ *   timekeeper_now_ns               ~ 27 ns   (vdso clock_gettime)
+ *   TK_ZONE_BEGIN / TK_ZONE_END     ~ 74 ns   (two clock reads + atomic commit)
+ *   TK_BENCH, per iteration         ~ 0.5 ns  (body inlined, clock read once)
+ *   timekeeper_benchmark_funct      ~ 574 ns  (two clock() syscalls + call)
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+#define TK_THREAD_LOCAL thread_local
+extern "C" {
+#else
+#define TK_THREAD_LOCAL _Thread_local
+#endif
+
+#define TK_HIST_BUCKETS 48      /* log2(ns) latency buckets */
+
+typedef struct Timekeeper_Zone {
+    const char * name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[TK_HIST_BUCKETS];
+    struct Timekeeper_Zone * next;
+    int registered;
+    uint64_t alloc_count;       /* charged by abyss built with ABYSS_TIMEKEEPER */
+    uint64_t alloc_bytes;
+} Timekeeper_Zone;
+
+#define TK_ZONE_INIT(zone_name) { zone_name, 0, 0, 0, {0}, 0, 0, 0, 0 }
+
+/* innermost active zone of the calling thread */
+extern TK_THREAD_LOCAL Timekeeper_Zone * timekeeper_zone_current;
+/* every zone that has been committed at least once */
+extern Timekeeper_Zone * timekeeper_zones;
+
+void timekeeper_zone_register(Timekeeper_Zone * zone);
+void timekeeper_zone_print();
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline uint64_t timekeeper_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t timekeeper_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return timekeeper_now_ns();
+#endif
+}
+
+static inline uint32_t timekeeper_hist_bucket(uint64_t ns)
+{
+    uint32_t bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    return bucket < TK_HIST_BUCKETS ? bucket : TK_HIST_BUCKETS - 1;
+}
+
+/* keeps the compiler from deleting a result it thinks is unused */
+static inline void timekeeper_do_not_optimize(const void * ptr)
+{
+    __asm__ volatile ("" : : "g"(ptr) : "memory");
+}
+
+static inline void timekeeper_zone_commit(Timekeeper_Zone * zone, uint64_t ns)
+{
+    if ( !zone->registered )
+        timekeeper_zone_register(zone);
+
+    __atomic_fetch_add(&zone->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&zone->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&zone->hist[timekeeper_hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&zone->max_ns, __ATOMIC_RELAXED);
+    while ( ns > max && !__atomic_compare_exchange_n(&zone->max_ns, &max, ns, 1,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+        ;
+}
+
+/* charges an allocation to the calling thread's active zone, if any */
+static inline void timekeeper_zone_alloc(size_t size)
+{
+    Timekeeper_Zone * zone = timekeeper_zone_current;
+
+    if ( !zone )
+        return;
+    __atomic_fetch_add(&zone->alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&zone->alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+/* TK_ZONE(parse_zone, "parse");
+ * TK_ZONE_BEGIN(parse_zone);
+ *     ...
+ * TK_ZONE_END(parse_zone);
+ * begin and end open and close a block, so they must pair in one scope. */
+#define TK_ZONE(var, zone_name) static Timekeeper_Zone var = TK_ZONE_INIT(zone_name)
+
+#define TK_ZONE_BEGIN(var) {                                                  \
+    Timekeeper_Zone * tk_prev_##var = timekeeper_zone_current;                \
+    timekeeper_zone_current = &(var);                                         \
+    uint64_t tk_start_##var = timekeeper_now_ns();
+
+#define TK_ZONE_END(var)                                                      \
+    timekeeper_zone_commit(&(var), timekeeper_now_ns() - tk_start_##var);     \
+    timekeeper_zone_current = tk_prev_##var;                                  \
+}
+
+/* runs body iters times between two clock reads,
+ * ns_per_iter receives the mean cost of one iteration */
+#define TK_BENCH(ns_per_iter, iters, body) do {                               \
+    uint64_t tk_n_ = (iters);                                                 \
+    uint64_t tk_t0_ = timekeeper_now_ns();                                    \
+    for ( uint64_t tk_i_ = 0; tk_i_ < tk_n_; tk_i_++ ) {                      \
+        body;                                                                 \
+    }                                                                         \
+    (ns_per_iter) = (double)(timekeeper_now_ns() - tk_t0_) / (double)tk_n_;   \
+} while ( 0 )
+
+/* batches of batch_size iterations, ns_per_iter receives the fastest
+ * batch's per-iteration cost, which filters out preemption noise */
+#define TK_BENCH_BATCH(ns_per_iter, batches, batch_size, body) do {           \
+    double tk_best_ = -1.0, tk_cur_;                                          \
+    for ( uint64_t tk_b_ = 0; tk_b_ < (uint64_t)(batches); tk_b_++ ) {        \
+        TK_BENCH(tk_cur_, batch_size, body);                                  \
+        if ( tk_best_ < 0.0 || tk_cur_ < tk_best_ )                           \
+            tk_best_ = tk_cur_;                                               \
+    }                                                                         \
+    (ns_per_iter) = tk_best_;                                                 \
+} while ( 0 )
+
+#ifdef TIMEKEEPER_IMPLEMENTATION
+
+#include <stdio.h>
+
+TK_THREAD_LOCAL Timekeeper_Zone * timekeeper_zone_current;
+Timekeeper_Zone * timekeeper_zones;
+
+void timekeeper_zone_register(Timekeeper_Zone * zone)
+{
+    int expected = 0;
+    if ( !__atomic_compare_exchange_n(&zone->registered, &expected, 1, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+        return;
+
+    zone->next = __atomic_load_n(&timekeeper_zones, __ATOMIC_ACQUIRE);
+    while ( !__atomic_compare_exchange_n(&timekeeper_zones, &zone->next, zone, 1,
+                                         __ATOMIC_RELEASE, __ATOMIC_ACQUIRE) )
+        ;
+}
+
+void timekeeper_zone_print()
+{
+    printf(" zone             │ calls      │ total(ms)  │ avg(ns)    │ max(ns)    │ allocs/call │ bytes/call\n");
+    printf("──────────────────┼────────────┼────────────┼────────────┼────────────┼─────────────┼────────────\n");
+
+    Timekeeper_Zone * zone;
+    for ( zone = timekeeper_zones; zone; zone = zone->next )
+    {
+        uint64_t count = zone->count ? zone->count : 1;
+        printf(" %-16s │ %-10llu │ %-10.3f │ %-10llu │ %-10llu │ %-11.2f │ %-10.1f\n"
+               ,zone->name, (unsigned long long)zone->count
+               ,(double)zone->total_ns/1e6
+               ,(unsigned long long)(zone->total_ns/count)
+               ,(unsigned long long)zone->max_ns
+               ,(double)zone->alloc_count/count
+               ,(double)zone->alloc_bytes/count);
+    }
+    printf("──────────────────┴────────────┴────────────┴────────────┴────────────┴─────────────┴────────────\n");
+}
+
+#endif // TIMEKEEPER_IMPLEMENTATION
+
+#endif // !TIMEKEEPER_INLINE_H
@@ -0,0 +1,433 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "../inc/timekeeper.h"
+
+#define AGENT_RING      4096    /* samples buffered between drains */
+#define AGENT_DEPTH     24      /* frames per sample */
+#define AGENT_SKIP      2       /* signal handler + trampoline */
+#define AGENT_STACKS    1024    /* distinct stacks per segment */
+#define AGENT_ZONES     128
+#define AGENT_LINE      4096
+
+typedef struct {
+    uint64_t ready;             /* slot + 1 once the sample is complete */
+    int depth;
+    void * pcs[AGENT_DEPTH];
+} Agent_Sample;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+    int depth;
+    void * pcs[AGENT_DEPTH];
+} Agent_Stack;
+
+typedef struct {
+    Timekeeper_Zone * zone;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t hist[TK_HIST_BUCKETS];
+} Agent_Zone_Mark;
+
+static struct {
+    Timekeeper_Agent_Config config;
+    pthread_t thread;
+    int running;
+    uint32_t segment;
+    struct sigaction prev_action;
+
+    Agent_Sample ring[AGENT_RING];
+    uint64_t head;
+    uint64_t tail;
+
+    Agent_Stack stacks[AGENT_STACKS];
+    uint64_t samples;
+    uint64_t dropped;
+
+    Agent_Zone_Mark marks[AGENT_ZONES];
+    uint32_t mark_count;
+} agent;
+
+static void agent_on_sample(int sig, siginfo_t * info, void * context)
+{
+    (void)sig;
+    (void)info;
+    (void)context;
+
+    int saved_errno = errno;
+    uint64_t slot = __atomic_fetch_add(&agent.head, 1, __ATOMIC_RELAXED);
+    Agent_Sample * sample = &agent.ring[slot % AGENT_RING];
+
+    __atomic_store_n(&sample->ready, 0, __ATOMIC_RELAXED);
+    sample->depth = backtrace(sample->pcs, AGENT_DEPTH);
+    __atomic_store_n(&sample->ready, slot + 1, __ATOMIC_RELEASE);
+    errno = saved_errno;
+}
+
+static void agent_drain()
+{
+    uint64_t head = __atomic_load_n(&agent.head, __ATOMIC_ACQUIRE);
+
+    if ( head - agent.tail > AGENT_RING ) {
+        agent.dropped += head - agent.tail - AGENT_RING;
+        agent.tail = head - AGENT_RING;
+    }
+
+    for ( ; agent.tail < head; agent.tail++ ) {
+        Agent_Sample * sample = &agent.ring[agent.tail % AGENT_RING];
+        if ( __atomic_load_n(&sample->ready, __ATOMIC_ACQUIRE) != agent.tail + 1 ) {
+            agent.dropped++;
+            continue;
+        }
+
+        uint64_t hash = 1469598103934665603ull;
+        for ( int i = AGENT_SKIP; i < sample->depth; i++ )
+            hash = (hash ^ (uint64_t)(uintptr_t)sample->pcs[i]) * 1099511628211ull;
+
+        uint32_t idx = (uint32_t)(hash % AGENT_STACKS), probes;
+        for ( probes = 0; probes < AGENT_STACKS; probes++, idx = (idx + 1) % AGENT_STACKS ) {
+            Agent_Stack * stack = &agent.stacks[idx];
+            if ( !stack->count ) {
+                stack->hash = hash;
+                stack->depth = sample->depth;
+                memcpy(stack->pcs, sample->pcs, sizeof(stack->pcs));
+            }
+            if ( stack->hash == hash ) {
+                stack->count++;
+                break;
+            }
+        }
+        if ( probes == AGENT_STACKS )
+            agent.dropped++;
+        agent.samples++;
+    }
+}
+
+static Agent_Zone_Mark * agent_mark(Timekeeper_Zone * zone)
+{
+    for ( uint32_t i = 0; i < agent.mark_count; i++ )
+        if ( agent.marks[i].zone == zone )
+            return &agent.marks[i];
+
+    if ( agent.mark_count == AGENT_ZONES )
+        return NULL;
+
+    Agent_Zone_Mark * mark = &agent.marks[agent.mark_count++];
+    memset(mark, 0, sizeof(*mark));
+    mark->zone = zone;
+    return mark;
+}
+
+static int agent_stack_cmp(const void * a, const void * b)
+{
+    uint64_t ca = ((const Agent_Stack *)a)->count, cb = ((const Agent_Stack *)b)->count;
+    return (ca < cb) - (ca > cb);
+}
+
+static void agent_path(char * buf, size_t len, uint32_t segment)
+{
+    snprintf(buf, len, "%s/segment.%03u.tkp", agent.config.dir, segment);
+}
+
+/* segment layout, one record per line:
+ *   tkp 1 <from> <to> <samples> <dropped>
+ *   z <name> <calls> <total_ns> <max_ns> <bucket>:<count>...
+ *   s <count> <module>+<offset>...
+ * records past the per-file budget are cut and a "t" line ends the file */
+static void agent_write_segment(time_t from, time_t to)
+{
+    char path[512];
+    uint64_t budget = agent.config.disk_budget / agent.config.max_segments;
+
+    agent_path(path, sizeof(path), agent.segment);
+    agent.segment = (agent.segment + 1) % agent.config.max_segments;
+
+    FILE * out = fopen(path, "w");
+    if ( !out )
+        return;
+
+    long written = fprintf(out, "tkp 1 %lld %lld %llu %llu\n", (long long)from, (long long)to
+                           ,(unsigned long long)agent.samples, (unsigned long long)agent.dropped);
+
+    Timekeeper_Zone * zone;
+    for ( zone = __atomic_load_n(&timekeeper_zones, __ATOMIC_ACQUIRE); zone; zone = zone->next ) {
+        Agent_Zone_Mark * mark = agent_mark(zone);
+        if ( !mark )
+            break;
+
+        uint64_t count = zone->count, total = zone->total_ns;
+        if ( count == mark->count )
+            continue;
+
+        written += fprintf(out, "z %s %llu %llu %llu", zone->name
+                           ,(unsigned long long)(count - mark->count)
+                           ,(unsigned long long)(total - mark->total_ns)
+                           ,(unsigned long long)zone->max_ns);
+        for ( uint32_t b = 0; b < TK_HIST_BUCKETS; b++ ) {
+            uint64_t hits = zone->hist[b];
+            if ( hits != mark->hist[b] )
+                written += fprintf(out, " %u:%llu", b, (unsigned long long)(hits - mark->hist[b]));
+            mark->hist[b] = hits;
+        }
+        written += fprintf(out, "\n");
+        mark->count = count;
+        mark->total_ns = total;
+    }
+
+    qsort(agent.stacks, AGENT_STACKS, sizeof(Agent_Stack), agent_stack_cmp);
+
+    for ( uint32_t i = 0; i < AGENT_STACKS && agent.stacks[i].count; i++ ) {
+        Agent_Stack * stack = &agent.stacks[i];
+        char line[AGENT_LINE];
+        int len = snprintf(line, sizeof(line), "s %llu", (unsigned long long)stack->count);
+
+        for ( int f = AGENT_SKIP; f < stack->depth && len < AGENT_LINE - 64; f++ ) {
+            Dl_info info;
+            const char * module = "?";
+            uintptr_t offset = (uintptr_t)stack->pcs[f];
+            if ( dladdr(stack->pcs[f], &info) && info.dli_fname ) {
+                module = strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/') + 1 : info.dli_fname;
+                offset -= (uintptr_t)info.dli_fbase;
+            }
+            len += snprintf(line + len, sizeof(line) - len, " %s+%lx", module, (unsigned long)offset);
+        }
+
+        if ( (uint64_t)(written + len + 1) > budget ) {
+            fprintf(out, "t\n");
+            break;
+        }
+        written += fprintf(out, "%s\n", line);
+    }
+
+    fclose(out);
+
+    memset(agent.stacks, 0, sizeof(agent.stacks));
+    agent.samples = 0;
+    agent.dropped = 0;
+}
+
+/* continue the rotation after the newest segment already on disk */
+static uint32_t agent_first_segment()
+{
+    long long newest = -1;
+    uint32_t next = 0;
+
+    for ( uint32_t i = 0; i < agent.config.max_segments; i++ ) {
+        char path[512];
+        long long from, to;
+        agent_path(path, sizeof(path), i);
+
+        FILE * in = fopen(path, "r");
+        if ( !in )
+            continue;
+        if ( fscanf(in, "tkp 1 %lld %lld", &from, &to) == 2 && to > newest ) {
+            newest = to;
+            next = (i + 1) % agent.config.max_segments;
+        }
+        fclose(in);
+    }
+    return next;
+}
+
+static void * agent_loop(void * arg)
+{
+    (void)arg;
+    time_t from = time(NULL);
+
+    while ( __atomic_load_n(&agent.running, __ATOMIC_ACQUIRE) ) {
+        struct timespec second = { 1, 0 };
+        nanosleep(&second, NULL);
+        agent_drain();
+
+        time_t now = time(NULL);
+        if ( now - from >= (time_t)agent.config.period_s ) {
+            agent_write_segment(from, now);
+            from = now;
+        }
+    }
+
+    agent_drain();
+    agent_write_segment(from, time(NULL));
+    return NULL;
+}
+
+/* a SIGPROF still pending when the timer stops would hit the restored
+ * action, which kills the process when that is SIG_DFL. ignoring it first
+ * discards the pending signal */
+static void agent_restore_signal()
+{
+    signal(SIGPROF, SIG_IGN);
+    sigaction(SIGPROF, &agent.prev_action, NULL);
+}
+
+int timekeeper_agent_start(const Timekeeper_Agent_Config * config)
+{
+    if ( agent.running || !config || !config->dir )
+        return -1;
+
+    agent.config = *config;
+    if ( !agent.config.hz )           agent.config.hz = 19;
+    if ( !agent.config.period_s )     agent.config.period_s = 60;
+    if ( !agent.config.max_segments ) agent.config.max_segments = 16;
+    if ( !agent.config.disk_budget )  agent.config.disk_budget = 16 << 20;
+
+    agent.segment = agent_first_segment();
+    agent.head = agent.tail = 0;
+
+    /* the first backtrace loads libgcc, which is not safe in a handler */
+    void * warmup[4];
+    backtrace(warmup, 4);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = agent_on_sample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if ( sigaction(SIGPROF, &action, &agent.prev_action) )
+        return -1;
+
+    agent.running = 1;
+    if ( pthread_create(&agent.thread, NULL, agent_loop, NULL) ) {
+        agent.running = 0;
+        agent_restore_signal();
+        return -1;
+    }
+
+    /* tv_usec must stay below 1000000, so hz == 1 needs tv_sec */
+    uint64_t interval_us = 1000000ull / agent.config.hz;
+    if ( !interval_us )
+        interval_us = 1;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = (time_t)(interval_us / 1000000);
+    timer.it_interval.tv_usec = (suseconds_t)(interval_us % 1000000);
+    timer.it_value = timer.it_interval;
+    if ( setitimer(ITIMER_PROF, &timer, NULL) ) {
+        __atomic_store_n(&agent.running, 0, __ATOMIC_RELEASE);
+        pthread_join(agent.thread, NULL);
+        agent_restore_signal();
+        return -1;
+    }
+    return 0;
+}
+
+void timekeeper_agent_stop()
+{
+    if ( !agent.running )
+        return;
+
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+
+    __atomic_store_n(&agent.running, 0, __ATOMIC_RELEASE);
+    pthread_join(agent.thread, NULL);
+    agent_restore_signal();
+}
+
+typedef struct {
+    char * key;
+    uint64_t count;
+    uint64_t total_ns;
+} Agent_Entry;
+
+static void agent_merge(Agent_Entry * entries, uint32_t * len, uint32_t cap,
+                        const char * key, uint64_t count, uint64_t total_ns)
+{
+    for ( uint32_t i = 0; i < *len; i++ ) {
+        if ( !strcmp(entries[i].key, key) ) {
+            entries[i].count += count;
+            entries[i].total_ns += total_ns;
+            return;
+        }
+    }
+    if ( *len == cap )
+        return;
+    entries[*len].key = strdup(key);
+    entries[*len].count = count;
+    entries[*len].total_ns = total_ns;
+    (*len)++;
+}
+
+static int agent_entry_cmp(const void * a, const void * b)
+{
+    uint64_t ca = ((const Agent_Entry *)a)->count, cb = ((const Agent_Entry *)b)->count;
+    return (ca < cb) - (ca > cb);
+}
+
+/* merges the segments overlapping [from, to] and prints zones and the
+ * hottest stacks, returns the number of segments used */
+int timekeeper_agent_dump(const char * dir, time_t from, time_t to, uint32_t max_segments)
+{
+    Agent_Entry * zones = calloc(AGENT_ZONES, sizeof(Agent_Entry));
+    Agent_Entry * stacks = calloc(AGENT_STACKS, sizeof(Agent_Entry));
+    uint32_t zone_len = 0, stack_len = 0;
+    uint64_t samples = 0;
+    int used = 0;
+    char * line = malloc(AGENT_LINE);
+
+    if ( !zones || !stacks || !line )
+        goto out;
+
+    for ( uint32_t i = 0; i < (max_segments ? max_segments : 16); i++ ) {
+        char path[512];
+        long long seg_from, seg_to;
+        unsigned long long seg_samples;
+
+        snprintf(path, sizeof(path), "%s/segment.%03u.tkp", dir, i);
+        FILE * in = fopen(path, "r");
+        if ( !in )
+            continue;
+
+        if ( fscanf(in, "tkp 1 %lld %lld %llu", &seg_from, &seg_to, &seg_samples) != 3
+             || seg_to < (long long)from || seg_from > (long long)to ) {
+            fclose(in);
+            continue;
+        }
+        used++;
+        samples += seg_samples;
+
+        while ( fgets(line, AGENT_LINE, in) ) {
+            char name[256];
+            unsigned long long count, total;
+            line[strcspn(line, "\n")] = '\0';
+
+            if ( line[0] == 'z' && sscanf(line, "z %255s %llu %llu", name, &count, &total) == 3 )
+                agent_merge(zones, &zone_len, AGENT_ZONES, name, count, total);
+            else if ( line[0] == 's' && sscanf(line, "s %llu", &count) == 1 )
+                agent_merge(stacks, &stack_len, AGENT_STACKS, strchr(line + 2, ' ') ? strchr(line + 2, ' ') + 1 : "", count, 0);
+        }
+        fclose(in);
+    }
+
+    printf(" segments: %d │ samples: %llu\n", used, (unsigned long long)samples);
+    printf(" zone             │ calls      │ total(ms)\n");
+    printf("──────────────────┼────────────┼────────────\n");
+    for ( uint32_t i = 0; i < zone_len; i++ )
+        printf(" %-16s │ %-10llu │ %-10.3f\n", zones[i].key
+               ,(unsigned long long)zones[i].count, (double)zones[i].total_ns/1e6);
+    printf("──────────────────┴────────────┴────────────\n");
+
+    qsort(stacks, stack_len, sizeof(Agent_Entry), agent_entry_cmp);
+    for ( uint32_t i = 0; i < stack_len && i < 20; i++ )
+        printf(" %6.2f%% %s\n", samples ? (double)stacks[i].count*100.0/samples : 0.0, stacks[i].key);
+
+out:
+    for ( uint32_t i = 0; zones && i < zone_len; i++ )
+        free(zones[i].key);
+    for ( uint32_t i = 0; stacks && i < stack_len; i++ )
+        free(stacks[i].key);
+    free(zones);
+    free(stacks);
+    free(line);
+    return used;
+}
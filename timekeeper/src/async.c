@@ -0,0 +1,138 @@
+#include <stdio.h>
+
+#include "../inc/timekeeper.h"
+
+#define ASYNC_FREE 0
+#define ASYNC_BUSY UINT64_MAX   /* slot claimed by a begin or an end */
+
+typedef struct {
+    uint64_t handle;
+    uint64_t start_ns;
+    uint32_t type;
+} Async_Slot;
+
+typedef struct {
+    const char * name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t lost;              /* slot reused before the op ended */
+    uint64_t stale;             /* ended after being counted lost, or twice */
+    uint64_t hist[TK_HIST_BUCKETS];
+} Async_Type;
+
+static Async_Slot slots[TK_ASYNC_SLOTS];
+static Async_Type types[TK_ASYNC_TYPES];
+static uint64_t async_next;
+
+void timekeeper_async_type(uint32_t type, const char * name)
+{
+    if ( type < TK_ASYNC_TYPES )
+        types[type].name = name;
+}
+
+Timekeeper_Async timekeeper_async_begin(uint32_t type)
+{
+    if ( type >= TK_ASYNC_TYPES )
+        return 0;
+
+    while ( 1 ) {
+        uint64_t handle = __atomic_fetch_add(&async_next, 1, __ATOMIC_RELAXED) + 1;
+        Async_Slot * slot = &slots[handle % TK_ASYNC_SLOTS];
+
+        uint64_t old = __atomic_load_n(&slot->handle, __ATOMIC_RELAXED);
+        if ( old == ASYNC_BUSY
+             || !__atomic_compare_exchange_n(&slot->handle, &old, ASYNC_BUSY, 0,
+                                             __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) )
+            continue;
+
+        if ( old != ASYNC_FREE )
+            __atomic_fetch_add(&types[slot->type].lost, 1, __ATOMIC_RELAXED);
+
+        slot->type = type;
+        slot->start_ns = timekeeper_now_ns();
+        __atomic_store_n(&slot->handle, handle, __ATOMIC_RELEASE);
+        return handle;
+    }
+}
+
+void timekeeper_async_end(Timekeeper_Async handle)
+{
+    uint64_t now = timekeeper_now_ns();
+
+    if ( !handle )
+        return;
+
+    Async_Slot * slot = &slots[handle % TK_ASYNC_SLOTS];
+    uint64_t expected = handle;
+    if ( !__atomic_compare_exchange_n(&slot->handle, &expected, ASYNC_BUSY, 0,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ) {
+        __atomic_fetch_add(&types[0].stale, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t type = slot->type;
+    uint64_t ns = now - slot->start_ns;
+    __atomic_store_n(&slot->handle, ASYNC_FREE, __ATOMIC_RELEASE);
+
+    Async_Type * stats = &types[type];
+    __atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->hist[timekeeper_hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&stats->max_ns, __ATOMIC_RELAXED);
+    while ( ns > max && !__atomic_compare_exchange_n(&stats->max_ns, &max, ns, 1,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+        ;
+}
+
+/* prints and counts the operations still open after older_than_ns */
+uint32_t timekeeper_async_pending(uint64_t older_than_ns)
+{
+    uint64_t now = timekeeper_now_ns();
+    uint32_t pending = 0;
+
+    for ( uint32_t i = 0; i < TK_ASYNC_SLOTS; i++ ) {
+        uint64_t handle = __atomic_load_n(&slots[i].handle, __ATOMIC_ACQUIRE);
+        if ( handle == ASYNC_FREE || handle == ASYNC_BUSY )
+            continue;
+
+        uint64_t start = slots[i].start_ns;
+        if ( now < start || now - start < older_than_ns )
+            continue;
+
+        uint32_t type = slots[i].type;
+        printf(" pending: %-16s │ handle %-10llu │ open %.3f ms\n"
+               ,types[type].name ? types[type].name : "?"
+               ,(unsigned long long)handle, (double)(now - start)/1e6);
+        pending++;
+    }
+    return pending;
+}
+
+void timekeeper_async_print()
+{
+    printf(" operation        │ done       │ lost     │ avg(us)    │ p50(us)    │ p99(us)    │ max(us)\n");
+    printf("──────────────────┼────────────┼──────────┼────────────┼────────────┼────────────┼────────────\n");
+
+    uint64_t stale = 0;
+    for ( uint32_t t = 0; t < TK_ASYNC_TYPES; t++ )
+    {
+        Async_Type * stats = &types[t];
+        stale += stats->stale;
+        if ( !stats->count && !stats->lost )
+            continue;
+
+        uint64_t count = stats->count ? stats->count : 1;
+        printf(" %-16s │ %-10llu │ %-8llu │ %-10.2f │ %-10.2f │ %-10.2f │ %-10.2f\n"
+               ,stats->name ? stats->name : "?"
+               ,(unsigned long long)stats->count, (unsigned long long)stats->lost
+               ,(double)stats->total_ns/count/1e3
+               ,(double)timekeeper_hist_percentile(stats->hist, 0.50)/1e3
+               ,(double)timekeeper_hist_percentile(stats->hist, 0.99)/1e3
+               ,(double)stats->max_ns/1e3);
+    }
+    printf("──────────────────┴────────────┴──────────┴────────────┴────────────┴────────────┴────────────\n");
+    if ( stale )
+        printf(" %llu ends matched no open operation\n", (unsigned long long)stale);
+}
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+
+#include "../inc/timekeeper.h"
+
+#define BUDGET_MARK SIGUSR2     /* raised by the traced child at the end */
+
+static _Thread_local uint64_t budget_allocs;
+
+void timekeeper_budget_count_alloc(void * ptr, size_t size)
+{
+    (void)ptr;
+    (void)size;
+    budget_allocs++;
+}
+
+/* parent side of the fallback: single-step the child until it raises the
+ * end mark, one step per retired instruction */
+static int budget_trace(Timekeeper_Budget * budget, pid_t pid, int pipe_fd)
+{
+    int status;
+    uint64_t steps = 0;
+
+    if ( waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status) ) {
+        close(pipe_fd);
+        return -1;
+    }
+
+    while ( 1 ) {
+        if ( ptrace(PTRACE_SINGLESTEP, pid, 0, 0) == -1 )
+            break;
+        if ( waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status) )
+            break;
+        if ( WSTOPSIG(status) == BUDGET_MARK ) {
+            ptrace(PTRACE_CONT, pid, 0, 0);
+            break;
+        }
+        steps++;
+    }
+
+    uint64_t allocs;
+    int ok = read(pipe_fd, &allocs, sizeof(allocs)) == sizeof(allocs);
+    close(pipe_fd);
+    waitpid(pid, &status, 0);
+
+    if ( !ok )
+        return -1;
+
+    budget->instructions = steps;
+    budget->allocs = allocs;
+    budget->counted = 1;
+    return 0;
+}
+
+int timekeeper_budget_begin(Timekeeper_Budget * budget)
+{
+    budget->child = 0;
+    budget->counted = 0;
+    budget->instructions = 0;
+    budget->allocs = 0;
+    budget->pipe_fd = -1;
+    budget->fd = -1;
+
+    if ( !getenv("TIMEKEEPER_BUDGET_STEP") )
+        budget->fd = timekeeper_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+
+    if ( budget->fd < 0 ) {
+        int fds[2];
+        if ( pipe(fds) )
+            goto in_process;
+
+        pid_t pid = fork();
+        if ( pid < 0 ) {
+            close(fds[0]);
+            close(fds[1]);
+            goto in_process;
+        }
+
+        if ( pid == 0 ) {
+            close(fds[0]);
+            if ( ptrace(PTRACE_TRACEME, 0, 0, 0) == -1 )
+                _exit(127);
+            budget->child = 1;
+            budget->pipe_fd = fds[1];
+            budget->alloc_start = budget_allocs;
+            raise(SIGSTOP);
+            return 1;
+        }
+
+        close(fds[1]);
+        if ( !budget_trace(budget, pid, fds[0]) )
+            return 0;
+        /* the child could not be traced, run in process uncounted */
+    }
+
+in_process:
+    budget->alloc_start = budget_allocs;
+    if ( budget->fd >= 0 )
+        timekeeper_counter_start(budget->fd);
+    return 1;
+}
+
+void timekeeper_budget_end(Timekeeper_Budget * budget)
+{
+    if ( budget->child ) {
+        uint64_t allocs = budget_allocs - budget->alloc_start;
+        raise(BUDGET_MARK);
+        if ( write(budget->pipe_fd, &allocs, sizeof(allocs)) != sizeof(allocs) )
+            _exit(1);
+        _exit(0);
+    }
+
+    budget->allocs = budget_allocs - budget->alloc_start;
+    if ( budget->fd >= 0 ) {
+        budget->instructions = timekeeper_counter_stop(budget->fd);
+        budget->counted = 1;
+        timekeeper_counter_close(budget->fd);
+        budget->fd = -1;
+    }
+}
+
+void timekeeper_budget_check(const Timekeeper_Budget * budget,
+                             uint64_t max_instructions, uint64_t max_allocs,
+                             const char * code, const char * file_name, uint32_t line_number)
+{
+    int failed = 0;
+
+    if ( !budget->counted )
+        fprintf(stderr, "%s:%u: no instruction counter, only allocations checked\n"
+                ,file_name, line_number);
+
+    if ( budget->counted && budget->instructions > max_instructions ) {
+        fprintf(stderr, "%s:%u: budget exceeded: %s: %llu instructions (max %llu)\n"
+                ,file_name, line_number, code
+                ,(unsigned long long)budget->instructions
+                ,(unsigned long long)max_instructions);
+        failed = 1;
+    }
+
+    if ( budget->allocs > max_allocs ) {
+        fprintf(stderr, "%s:%u: budget exceeded: %s: %llu allocations (max %llu)\n"
+                ,file_name, line_number, code
+                ,(unsigned long long)budget->allocs
+                ,(unsigned long long)max_allocs);
+        failed = 1;
+    }
+
+    if ( failed )
+        abort();
+}
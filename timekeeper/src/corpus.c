@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../inc/timekeeper.h"
+
+int timekeeper_corpus_open(Timekeeper_Corpus * corpus, const char * path, uint32_t flags)
+{
+    struct stat st;
+
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->flags = flags;
+    corpus->seed = timekeeper_now_ns() | 1;
+
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+    if ( fstat(fd, &st) || !st.st_size ) {
+        close(fd);
+        return -1;
+    }
+
+    int map_flags = MAP_PRIVATE;
+    if ( flags & TK_CORPUS_POPULATE )
+        map_flags |= MAP_POPULATE;
+
+    void * base = mmap(NULL, st.st_size, PROT_READ, map_flags, fd, 0);
+    close(fd);
+    if ( base == MAP_FAILED )
+        return -1;
+
+    /* best effort: file-backed thp needs kernel support */
+    if ( flags & TK_CORPUS_HUGE )
+        madvise(base, st.st_size, MADV_HUGEPAGE);
+    madvise(base, st.st_size, (flags & TK_CORPUS_RANDOM) ? MADV_RANDOM : MADV_SEQUENTIAL);
+
+    corpus->base = base;
+    corpus->size = st.st_size;
+    return timekeeper_corpus_fixed(corpus, st.st_size);
+}
+
+static int corpus_index(Timekeeper_Corpus * corpus, uint64_t count)
+{
+    free(corpus->offsets);
+    free(corpus->order);
+    corpus->offsets = NULL;
+    corpus->order = NULL;
+    corpus->cursor = 0;
+    corpus->count = 0;
+    corpus->delimiter = -1;
+
+    if ( count > UINT32_MAX )
+        return -1;
+
+    corpus->offsets = malloc((count + 1) * sizeof(uint64_t));
+    if ( !corpus->offsets )
+        return -1;
+
+    if ( corpus->flags & TK_CORPUS_RANDOM ) {
+        corpus->order = malloc(count * sizeof(uint32_t));
+        if ( !corpus->order )
+            return -1;
+        for ( uint64_t i = 0; i < count; i++ )
+            corpus->order[i] = (uint32_t)i;
+    }
+    corpus->count = count;
+    return 0;
+}
+
+int timekeeper_corpus_fixed(Timekeeper_Corpus * corpus, size_t record_size)
+{
+    if ( !record_size )
+        return -1;
+
+    uint64_t count = corpus->size / record_size;
+    if ( corpus_index(corpus, count) )
+        return -1;
+
+    for ( uint64_t i = 0; i <= count; i++ )
+        corpus->offsets[i] = i * record_size;
+    return 0;
+}
+
+int timekeeper_corpus_split(Timekeeper_Corpus * corpus, char delimiter)
+{
+    uint64_t count = 0;
+    const uint8_t * cursor = corpus->base, * end = corpus->base + corpus->size;
+
+    while ( cursor < end ) {
+        const uint8_t * next = memchr(cursor, delimiter, end - cursor);
+        count++;
+        cursor = next ? next + 1 : end;
+    }
+
+    if ( corpus_index(corpus, count) )
+        return -1;
+
+    /* offsets[i + 1] is one past the delimiter ending record i */
+    uint64_t i = 0;
+    corpus->offsets[0] = 0;
+    for ( cursor = corpus->base; cursor < end; ) {
+        const uint8_t * next = memchr(cursor, delimiter, end - cursor);
+        cursor = next ? next + 1 : end;
+        corpus->offsets[++i] = cursor - corpus->base;
+    }
+    corpus->delimiter = (uint8_t)delimiter;
+    return 0;
+}
+
+static void corpus_shuffle(Timekeeper_Corpus * corpus)
+{
+    for ( uint64_t i = corpus->count; i > 1; i-- ) {
+        corpus->seed ^= corpus->seed << 13;
+        corpus->seed ^= corpus->seed >> 7;
+        corpus->seed ^= corpus->seed << 17;
+        uint64_t j = corpus->seed % i;
+        uint32_t tmp = corpus->order[i - 1];
+        corpus->order[i - 1] = corpus->order[j];
+        corpus->order[j] = tmp;
+    }
+}
+
+Timekeeper_Slice timekeeper_corpus_next(Timekeeper_Corpus * corpus)
+{
+    Timekeeper_Slice slice = { NULL, 0 };
+
+    if ( !corpus->count )
+        return slice;
+
+    if ( corpus->cursor == corpus->count )
+        corpus->cursor = 0;
+    if ( corpus->order && corpus->cursor == 0 )
+        corpus_shuffle(corpus);
+
+    uint64_t index = corpus->order ? corpus->order[corpus->cursor] : corpus->cursor;
+    corpus->cursor++;
+
+    uint64_t start = corpus->offsets[index], end = corpus->offsets[index + 1];
+    if ( corpus->delimiter >= 0 && end > start && corpus->base[end - 1] == (uint8_t)corpus->delimiter )
+        end--;
+    slice.data = corpus->base + start;
+    slice.len = end - start;
+    return slice;
+}
+
+void timekeeper_corpus_close(Timekeeper_Corpus * corpus)
+{
+    if ( corpus->base )
+        munmap((void *)corpus->base, corpus->size);
+    free(corpus->offsets);
+    free(corpus->order);
+    memset(corpus, 0, sizeof(*corpus));
+}
+
+/* ns per record over iterations records, slices are handed out zero-copy.
+ * the clock is read once per call, so the (cheap) record lookup and the
+ * reshuffle at the start of every random pass are included */
+double timekeeper_benchmark_corpus(Timekeeper_Corpus * corpus, Void_Funct_Slice funct,
+                                   void * arg, uint64_t iterations)
+{
+    if ( !corpus->count || !iterations )
+        return 0.0;
+
+    uint64_t start = timekeeper_now_ns();
+    for ( uint64_t i = 0; i < iterations; i++ )
+        funct(timekeeper_corpus_next(corpus), arg);
+    return (double)(timekeeper_now_ns() - start) / (double)iterations;
+}
@@ -0,0 +1,45 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../inc/timekeeper.h"
+
+int timekeeper_counter_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void timekeeper_counter_start(int fd)
+{
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+uint64_t timekeeper_counter_stop(int fd)
+{
+    uint64_t value = 0;
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if ( read(fd, &value, sizeof(value)) != sizeof(value) )
+        return 0;
+    return value;
+}
+
+void timekeeper_counter_close(int fd)
+{
+    if ( fd >= 0 )
+        close(fd);
+}
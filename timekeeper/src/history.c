@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../inc/timekeeper.h"
+
+#define HISTORY_FIELD      128
+#define HISTORY_LINE       512
+#define HISTORY_MIN_SEG    3    /* runs on each side of a change point */
+#define HISTORY_RESOLUTION 1e-3 /* sigma floor, relative to the mean */
+
+typedef struct {
+    char revision[HISTORY_FIELD];
+    double value;
+} History_Run;
+
+static void history_revision(char * buf, size_t len)
+{
+    const char * env = getenv("TIMEKEEPER_REVISION");
+    snprintf(buf, len, "unknown");
+
+    if ( env && *env ) {
+        snprintf(buf, len, "%s", env);
+        return;
+    }
+
+    FILE * git = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    if ( !git )
+        return;
+    if ( fgets(buf, len, git) )
+        buf[strcspn(buf, "\n")] = '\0';
+    if ( pclose(git) || !*buf )
+        snprintf(buf, len, "unknown");
+}
+
+/* hostname plus a hash of the cpu model and count, so a hardware change
+ * starts a new series even when the name stays */
+static void history_host(char * buf, size_t len)
+{
+    char host[64] = "unknown", line[256];
+    uint64_t hash = 1469598103934665603ull;
+
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+
+    FILE * cpuinfo = fopen("/proc/cpuinfo", "r");
+    if ( cpuinfo ) {
+        while ( fgets(line, sizeof(line), cpuinfo) )
+            if ( !strncmp(line, "model name", 10) )
+                for ( char * c = line; *c; c++ )
+                    hash = (hash ^ (uint8_t)*c) * 1099511628211ull;
+        fclose(cpuinfo);
+    }
+    hash ^= (uint64_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+    snprintf(buf, len, "%s/%08x", host, (uint32_t)(hash ^ (hash >> 32)));
+}
+
+/* line: <unix time> <revision> <host> <bench> <value> */
+int timekeeper_history_append(const char * path, const char * bench, double value)
+{
+    char revision[HISTORY_FIELD], host[HISTORY_FIELD];
+
+    history_revision(revision, sizeof(revision));
+    history_host(host, sizeof(host));
+
+    FILE * out = fopen(path, "a");
+    if ( !out )
+        return -1;
+    fprintf(out, "%lld %s %s %s %.17g\n", (long long)time(NULL), revision, host, bench, value);
+    return fclose(out) ? -1 : 0;
+}
+
+static int double_cmp(const void * a, const void * b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+/* noise estimate robust to level shifts: the median absolute difference of
+ * consecutive runs, scaled to a normal sigma. floored at 0.1% of the mean
+ * magnitude, noiseless or quantized series have a median diff of 0 and
+ * would otherwise never report a step. 0 only when every run is 0 */
+static double history_sigma(const History_Run * runs, uint32_t n)
+{
+    if ( n < 2 )
+        return 0.0;
+
+    double * diffs = malloc((n - 1) * sizeof(double));
+    if ( !diffs )
+        return 0.0;
+    double magnitude = fabs(runs[0].value);
+    for ( uint32_t i = 1; i < n; i++ ) {
+        diffs[i - 1] = fabs(runs[i].value - runs[i - 1].value);
+        magnitude += fabs(runs[i].value);
+    }
+    qsort(diffs, n - 1, sizeof(double), double_cmp);
+
+    double sigma = diffs[(n - 1) / 2] / (0.6745 * sqrt(2.0));
+    free(diffs);
+    return fmax(sigma, HISTORY_RESOLUTION * magnitude / (double)n);
+}
+
+static double history_mean(const History_Run * runs, uint32_t from, uint32_t to)
+{
+    double sum = 0.0;
+    for ( uint32_t i = from; i < to; i++ )
+        sum += runs[i].value;
+    return sum / (double)(to - from);
+}
+
+/* binary segmentation on the cusum statistic: split [from, to) where the
+ * cumulative deviation from the mean peaks, if the peak is significant.
+ * splits are collected in order */
+static void history_segment(const History_Run * runs, uint32_t from, uint32_t to,
+                            double sigma, double threshold, uint32_t * splits, uint32_t * count)
+{
+    uint32_t n = to - from;
+
+    if ( n < 2*HISTORY_MIN_SEG || sigma <= 0.0 )
+        return;
+
+    double mean = history_mean(runs, from, to), cusum = 0.0, peak = 0.0;
+    uint32_t split = 0;
+    for ( uint32_t i = from; i < to - 1; i++ ) {
+        cusum += runs[i].value - mean;
+        if ( i + 1 - from >= HISTORY_MIN_SEG && to - (i + 1) >= HISTORY_MIN_SEG && fabs(cusum) > peak ) {
+            peak = fabs(cusum);
+            split = i + 1;
+        }
+    }
+
+    if ( !split || peak / (sigma * sqrt((double)n)) < threshold )
+        return;
+
+    history_segment(runs, from, split, sigma, threshold, splits, count);
+    splits[(*count)++] = split;
+    history_segment(runs, split, to, sigma, threshold, splits, count);
+}
+
+/* prints the revisions where bench changed level on this host profile.
+ * threshold is the cusum significance, 1.36 is about 95%. returns the
+ * number of change points or -1 */
+int timekeeper_history_changes(const char * path, const char * bench, double threshold)
+{
+    char host[HISTORY_FIELD], line[HISTORY_LINE];
+    History_Run * runs = NULL;
+    uint32_t len = 0, cap = 0;
+
+    history_host(host, sizeof(host));
+
+    FILE * in = fopen(path, "r");
+    if ( !in )
+        return -1;
+
+    while ( fgets(line, sizeof(line), in) ) {
+        char revision[HISTORY_FIELD], run_host[HISTORY_FIELD], run_bench[HISTORY_FIELD];
+        long long stamp;
+        double value;
+
+        if ( sscanf(line, "%lld %127s %127s %127s %lf", &stamp, revision, run_host, run_bench, &value) != 5 )
+            continue;
+        if ( strcmp(run_host, host) || strcmp(run_bench, bench) )
+            continue;
+
+        if ( len == cap ) {
+            cap = cap ? cap * 2 : 64;
+            History_Run * grown = realloc(runs, cap * sizeof(History_Run));
+            if ( !grown ) {
+                free(runs);
+                fclose(in);
+                return -1;
+            }
+            runs = grown;
+        }
+        snprintf(runs[len].revision, HISTORY_FIELD, "%s", revision);
+        runs[len].value = value;
+        len++;
+    }
+    fclose(in);
+
+    uint32_t * splits = malloc((len / HISTORY_MIN_SEG + 2) * sizeof(uint32_t));
+    uint32_t found = 0;
+    if ( !splits ) {
+        free(runs);
+        return -1;
+    }
+    history_segment(runs, 0, len, history_sigma(runs, len), threshold, splits, &found);
+
+    /* levels are the means of the segments on either side of each split */
+    printf(" %s on %s: %u runs\n", bench, host, len);
+    printf(" revisions                    │ level                       │ shift\n");
+    printf("──────────────────────────────┼─────────────────────────────┼─────────\n");
+    for ( uint32_t i = 0; i < found; i++ ) {
+        uint32_t from = i ? splits[i - 1] : 0, to = i + 1 < found ? splits[i + 1] : len;
+        double before = history_mean(runs, from, splits[i]), after = history_mean(runs, splits[i], to);
+        printf(" %-12s -> %-12s │ %12.4g -> %-12.4g │ %+7.2f%%\n"
+               ,runs[splits[i] - 1].revision, runs[splits[i]].revision, before, after
+               ,before ? (after - before) / before * 100.0 : 0.0);
+    }
+    printf("──────────────────────────────┴─────────────────────────────┴─────────\n");
+
+    free(splits);
+    free(runs);
+    return (int)found;
+}
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "../inc/timekeeper.h"
+
+#define IO_ALIGN 4096           /* O_DIRECT buffer and block alignment */
+
+typedef struct {
+    uint64_t hist[TK_HIST_BUCKETS];
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} Io_Stats;
+
+static void io_record(Io_Stats * stats, uint64_t ns)
+{
+    stats->hist[timekeeper_hist_bucket(ns)]++;
+    stats->calls++;
+    stats->total_ns += ns;
+    if ( ns > stats->max_ns )
+        stats->max_ns = ns;
+}
+
+/* brings the file into the requested page-cache state, untimed */
+static int io_prepare(const char * path, uint32_t flags, uint8_t * buf, size_t block_size)
+{
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+
+    if ( flags & TK_IO_COLD ) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    } else if ( flags & TK_IO_HOT ) {
+        while ( read(fd, buf, block_size) > 0 )
+            ;
+    }
+    close(fd);
+    return 0;
+}
+
+static int64_t io_pass(const char * path, Timekeeper_Io_Method method, uint32_t flags,
+                       uint8_t * buf, size_t block_size, off_t size, Io_Stats * stats)
+{
+    int fd = open(path, O_RDONLY | ((flags & TK_IO_DIRECT) && method != TK_IO_MMAP ? O_DIRECT : 0));
+    if ( fd < 0 )
+        return -1;
+
+    int64_t bytes = 0;
+    ssize_t got = 1;
+    uint64_t start;
+
+    switch ( method ) {
+    case TK_IO_READ:
+        while ( got > 0 ) {
+            start = timekeeper_now_ns();
+            got = read(fd, buf, block_size);
+            io_record(stats, timekeeper_now_ns() - start);
+            bytes += got > 0 ? got : 0;
+        }
+        break;
+
+    case TK_IO_PREAD:
+        for ( off_t off = 0; off < size && got > 0; off += block_size ) {
+            start = timekeeper_now_ns();
+            got = pread(fd, buf, block_size, off);
+            io_record(stats, timekeeper_now_ns() - start);
+            bytes += got > 0 ? got : 0;
+        }
+        break;
+
+    case TK_IO_MMAP: {
+        uint8_t * map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( map == MAP_FAILED ) {
+            close(fd);
+            return -1;
+        }
+        /* touch one byte per page of every block */
+        uint64_t sum = 0;
+        for ( off_t off = 0; off < size; off += block_size ) {
+            off_t end = off + (off_t)block_size < size ? off + (off_t)block_size : size;
+            start = timekeeper_now_ns();
+            for ( off_t p = off; p < end; p += IO_ALIGN )
+                sum += map[p];
+            io_record(stats, timekeeper_now_ns() - start);
+            bytes += end - off;
+        }
+        timekeeper_do_not_optimize(&sum);
+        munmap(map, size);
+        break;
+    }
+
+    case TK_IO_BATCH: {
+        /* TK_IO_BATCH_DEPTH blocks per vectored call */
+        struct iovec iov[TK_IO_BATCH_DEPTH];
+        for ( off_t off = 0; off < size && got > 0; off += (off_t)block_size*TK_IO_BATCH_DEPTH ) {
+            for ( int i = 0; i < TK_IO_BATCH_DEPTH; i++ ) {
+                iov[i].iov_base = buf + (size_t)i*block_size;
+                iov[i].iov_len = block_size;
+            }
+            start = timekeeper_now_ns();
+            got = preadv(fd, iov, TK_IO_BATCH_DEPTH, off);
+            io_record(stats, timekeeper_now_ns() - start);
+            bytes += got > 0 ? got : 0;
+        }
+        break;
+    }
+    }
+
+    close(fd);
+    return got < 0 ? -1 : bytes;
+}
+
+int timekeeper_io_bench(const char * path, Timekeeper_Io_Method method, uint32_t flags,
+                        size_t block_size, uint32_t iterations, Timekeeper_Io_Result * result)
+{
+    struct stat st;
+    Io_Stats stats;
+    uint8_t * buf = NULL;
+    int ret = -1;
+
+    memset(result, 0, sizeof(*result));
+    memset(&stats, 0, sizeof(stats));
+
+    if ( !block_size || !iterations || stat(path, &st) || !st.st_size )
+        return -1;
+    if ( (flags & TK_IO_DIRECT) && block_size % IO_ALIGN )
+        return -1;
+
+    if ( posix_memalign((void **)&buf, IO_ALIGN, block_size * TK_IO_BATCH_DEPTH) )
+        return -1;
+
+    uint64_t total_ns = 0, best_ns = UINT64_MAX;
+    for ( uint32_t i = 0; i < iterations; i++ ) {
+        if ( io_prepare(path, flags, buf, block_size) )
+            goto out;
+
+        uint64_t start = timekeeper_now_ns();
+        int64_t bytes = io_pass(path, method, flags, buf, block_size, st.st_size, &stats);
+        uint64_t ns = timekeeper_now_ns() - start;
+        if ( bytes < 0 )
+            goto out;
+
+        total_ns += ns;
+        if ( ns < best_ns )
+            best_ns = ns;
+        result->bytes = (uint64_t)bytes;
+    }
+
+    result->iterations = iterations;
+    result->calls = stats.calls;
+    result->call_mean_ns = (double)stats.total_ns / (double)stats.calls;
+    result->call_p50_ns = (double)timekeeper_hist_percentile(stats.hist, 0.50);
+    result->call_p99_ns = (double)timekeeper_hist_percentile(stats.hist, 0.99);
+    result->call_max_ns = (double)stats.max_ns;
+    /* the histogram only knows bucket bounds */
+    if ( result->call_p50_ns > result->call_max_ns )
+        result->call_p50_ns = result->call_max_ns;
+    if ( result->call_p99_ns > result->call_max_ns )
+        result->call_p99_ns = result->call_max_ns;
+    result->pass_mean_ns = (double)total_ns / iterations;
+    result->mb_per_s = (double)result->bytes * 1e3 / result->pass_mean_ns;
+    result->best_mb_per_s = (double)result->bytes * 1e3 / (double)best_ns;
+    ret = 0;
+
+out:
+    free(buf);
+    return ret;
+}
+
+void timekeeper_io_print(const char * label, const Timekeeper_Io_Result * result)
+{
+    printf(" %-16s │ %8.1f MB/s (best %8.1f) │ call avg %8.1f us │ p50 %8.1f │ p99 %8.1f │ max %8.1f\n"
+           ,label, result->mb_per_s, result->best_mb_per_s
+           ,result->call_mean_ns/1e3, result->call_p50_ns/1e3
+           ,result->call_p99_ns/1e3, result->call_max_ns/1e3);
+}
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <linux/perf_event.h>
+
+#include "../inc/timekeeper.h"
+
+#define PAGES_HUGE (2u << 20)   /* pmd huge page size on x86-64 and arm64 */
+
+static const char * pages_names[] = { "4K", "THP", "hugetlb" };
+
+/* AnonHugePages of the mapping starting at base, from /proc/self/smaps */
+static uint64_t pages_huge_bytes(const void * base)
+{
+    char line[256];
+    uint64_t kb = 0;
+    int inside = 0;
+
+    FILE * smaps = fopen("/proc/self/smaps", "r");
+    if ( !smaps )
+        return 0;
+
+    while ( fgets(line, sizeof(line), smaps) ) {
+        unsigned long start, end;
+        if ( sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' ') ) {
+            inside = (uintptr_t)base >= start && (uintptr_t)base < end;
+            continue;
+        }
+        unsigned long long value;
+        if ( inside && sscanf(line, "AnonHugePages: %llu kB", &value) == 1 ) {
+            kb = value;
+            break;
+        }
+    }
+    fclose(smaps);
+    return kb * 1024;
+}
+
+/* 2 MiB aligned anonymous mapping of size bytes in the requested page mode */
+static uint8_t * pages_map(size_t size, Timekeeper_Pages pages, size_t * mapped)
+{
+    *mapped = (size + PAGES_HUGE - 1) / PAGES_HUGE * PAGES_HUGE;
+
+    if ( pages == TK_PAGES_HUGETLB ) {
+        void * buf = mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        return buf == MAP_FAILED ? NULL : buf;
+    }
+
+    /* over-map and trim so the buffer starts on a huge page boundary */
+    uint8_t * raw = mmap(NULL, *mapped + PAGES_HUGE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( raw == MAP_FAILED )
+        return NULL;
+
+    uint8_t * buf = (uint8_t *)(((uintptr_t)raw + PAGES_HUGE - 1) & ~((uintptr_t)PAGES_HUGE - 1));
+    if ( buf > raw )
+        munmap(raw, buf - raw);
+    munmap(buf + *mapped, raw + PAGES_HUGE - buf);
+
+    madvise(buf, *mapped, pages == TK_PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    return buf;
+}
+
+int timekeeper_pages_bench(size_t size, Timekeeper_Pages pages,
+                           Void_Funct_Buffer init, Void_Funct_Buffer funct, void * arg,
+                           uint32_t iterations, Timekeeper_Pages_Result * result)
+{
+    size_t mapped;
+
+    memset(result, 0, sizeof(*result));
+    if ( !size || !iterations )
+        return -1;
+
+    uint8_t * buf = pages_map(size, pages, &mapped);
+    if ( !buf )
+        return -1;
+
+    /* faults happen here, untimed */
+    if ( init )
+        init(buf, size, arg);
+    else
+        memset(buf, 0, size);
+    result->huge_bytes = pages == TK_PAGES_HUGETLB ? mapped : pages_huge_bytes(buf);
+    if ( result->huge_bytes > size )
+        result->huge_bytes = size;
+
+    int fd = timekeeper_counter_open(PERF_TYPE_HW_CACHE,
+                                     PERF_COUNT_HW_CACHE_DTLB
+                                     | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    if ( fd >= 0 )
+        timekeeper_counter_start(fd);
+
+    uint64_t start = timekeeper_now_ns();
+    for ( uint32_t i = 0; i < iterations; i++ )
+        funct(buf, size, arg);
+    uint64_t ns = timekeeper_now_ns() - start;
+
+    if ( fd >= 0 ) {
+        result->dtlb_misses = timekeeper_counter_stop(fd) / iterations;
+        result->counted = 1;
+        timekeeper_counter_close(fd);
+    }
+
+    result->ns = (double)ns / iterations;
+    munmap(buf, mapped);
+    return 0;
+}
+
+/* runs funct over the same working set in every page mode and prints the
+ * latency and dTLB misses relative to 4K pages */
+void timekeeper_pages_compare(size_t size, Void_Funct_Buffer init, Void_Funct_Buffer funct,
+                              void * arg, uint32_t iterations)
+{
+    Timekeeper_Pages_Result results[3];
+    int ok[3];
+
+    for ( int p = TK_PAGES_4K; p <= TK_PAGES_HUGETLB; p++ )
+        ok[p] = !timekeeper_pages_bench(size, (Timekeeper_Pages)p, init, funct, arg, iterations, &results[p]);
+
+    printf(" pages    │ ns/iter      │ vs 4K    │ dTLB miss/iter │ huge backed\n");
+    printf("──────────┼──────────────┼──────────┼────────────────┼─────────────\n");
+    for ( int p = TK_PAGES_4K; p <= TK_PAGES_HUGETLB; p++ ) {
+        if ( !ok[p] ) {
+            printf(" %-8s │ unavailable\n", pages_names[p]);
+            continue;
+        }
+        char misses[32] = "n/a";
+        if ( results[p].counted )
+            snprintf(misses, sizeof(misses), "%llu", (unsigned long long)results[p].dtlb_misses);
+        printf(" %-8s │ %-12.1f │ %+7.2f%% │ %-14s │ %5.1f%%\n", pages_names[p], results[p].ns
+               ,ok[0] ? (results[p].ns - results[0].ns) / results[0].ns * 100.0 : 0.0
+               ,misses, (double)results[p].huge_bytes * 100.0 / size);
+    }
+    printf("──────────┴──────────────┴──────────┴────────────────┴─────────────\n");
+}
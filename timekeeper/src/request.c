@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../inc/timekeeper.h"
+
+#define STAGE_HANDOFF (TK_STAGE_MAX)        /* time spent between threads */
+#define STAGE_OTHER   (TK_STAGE_MAX + 1)    /* time outside any stage */
+#define STAGE_SLOTS   (TK_STAGE_MAX + 2)
+
+struct Timekeeper_Request {
+    uint64_t id;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t mark_ns;           /* start of the open stage or handoff */
+    int32_t stage;              /* open stage, -1 when none */
+    uint32_t done;
+    uint64_t stage_ns[STAGE_SLOTS];
+};
+
+static Timekeeper_Request requests[TK_REQUEST_MAX];
+static uint64_t request_next;
+static const char * stage_names[TK_STAGE_MAX];
+
+static _Thread_local Timekeeper_Request * request_current;
+
+void timekeeper_stage_name(uint32_t stage, const char * name)
+{
+    if ( stage < TK_STAGE_MAX )
+        stage_names[stage] = name;
+}
+
+void timekeeper_request_begin(uint64_t request_id)
+{
+    uint64_t slot = __atomic_fetch_add(&request_next, 1, __ATOMIC_RELAXED);
+    Timekeeper_Request * req = &requests[slot % TK_REQUEST_MAX];
+
+    __atomic_store_n(&req->done, 0, __ATOMIC_RELAXED);
+    memset(req->stage_ns, 0, sizeof(req->stage_ns));
+    req->id = request_id;
+    req->stage = -1;
+    req->start_ns = timekeeper_now_ns();
+
+    request_current = req;
+}
+
+void timekeeper_stage_begin(uint32_t stage)
+{
+    Timekeeper_Request * req = request_current;
+
+    if ( !req || stage >= TK_STAGE_MAX )
+        return;
+
+    uint64_t now = timekeeper_now_ns();
+    if ( req->stage >= 0 )
+        req->stage_ns[req->stage] += now - req->mark_ns;
+    req->stage = (int32_t)stage;
+    req->mark_ns = now;
+}
+
+void timekeeper_stage_end()
+{
+    Timekeeper_Request * req = request_current;
+
+    if ( !req || req->stage < 0 )
+        return;
+
+    req->stage_ns[req->stage] += timekeeper_now_ns() - req->mark_ns;
+    req->stage = -1;
+}
+
+Timekeeper_Request * timekeeper_request_handoff()
+{
+    Timekeeper_Request * req = request_current;
+
+    if ( !req )
+        return NULL;
+
+    timekeeper_stage_end();
+    req->mark_ns = timekeeper_now_ns();
+    request_current = NULL;
+    return req;
+}
+
+void timekeeper_request_adopt(Timekeeper_Request * req)
+{
+    if ( !req )
+        return;
+
+    req->stage_ns[STAGE_HANDOFF] += timekeeper_now_ns() - req->mark_ns;
+    request_current = req;
+}
+
+void timekeeper_request_end()
+{
+    Timekeeper_Request * req = request_current;
+
+    if ( !req )
+        return;
+
+    timekeeper_stage_end();
+    req->end_ns = timekeeper_now_ns();
+
+    uint64_t staged = 0;
+    for ( uint32_t i = 0; i < STAGE_OTHER; i++ )
+        staged += req->stage_ns[i];
+    uint64_t total = req->end_ns - req->start_ns;
+    req->stage_ns[STAGE_OTHER] = total > staged ? total - staged : 0;
+
+    __atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+    request_current = NULL;
+}
+
+static int request_cmp(const void * a, const void * b)
+{
+    uint64_t ta = (*(Timekeeper_Request * const *)a)->end_ns - (*(Timekeeper_Request * const *)a)->start_ns;
+    uint64_t tb = (*(Timekeeper_Request * const *)b)->end_ns - (*(Timekeeper_Request * const *)b)->start_ns;
+    return (ta > tb) - (ta < tb);
+}
+
+static int u64_cmp(const void * a, const void * b)
+{
+    uint64_t ua = *(const uint64_t *)a, ub = *(const uint64_t *)b;
+    return (ua > ub) - (ua < ub);
+}
+
+static const char * request_stage_label(uint32_t stage, char * buf, size_t len)
+{
+    if ( stage == STAGE_HANDOFF )
+        return "(handoff)";
+    if ( stage == STAGE_OTHER )
+        return "(unstaged)";
+    if ( stage_names[stage] )
+        return stage_names[stage];
+    snprintf(buf, len, "stage %u", stage);
+    return buf;
+}
+
+/* compares the slowest 1% against the median of every stage */
+void timekeeper_request_report()
+{
+    Timekeeper_Request ** done = malloc(TK_REQUEST_MAX * sizeof(Timekeeper_Request *));
+    uint64_t * column = malloc(TK_REQUEST_MAX * sizeof(uint64_t));
+    uint32_t n = 0;
+
+    if ( !done || !column )
+        goto out;
+
+    for ( uint32_t i = 0; i < TK_REQUEST_MAX; i++ )
+        if ( __atomic_load_n(&requests[i].done, __ATOMIC_ACQUIRE) )
+            done[n++] = &requests[i];
+
+    if ( !n ) {
+        printf(" no completed requests\n");
+        goto out;
+    }
+
+    qsort(done, n, sizeof(Timekeeper_Request *), request_cmp);
+
+    uint32_t tail = n - n / 100;        /* first index of the slowest 1% */
+    if ( tail == n )
+        tail = n - 1;
+    uint32_t slow = n - tail;
+
+    printf(" requests: %u │ median %.1f us │ p99 %.1f us\n", n
+           ,(double)(done[n/2]->end_ns - done[n/2]->start_ns)/1e3
+           ,(double)(done[tail]->end_ns - done[tail]->start_ns)/1e3);
+    printf(" stage            │ median(us) │ p99 avg(us) │ excess(us) │ share\n");
+    printf("──────────────────┼────────────┼─────────────┼────────────┼────────\n");
+
+    double excess[STAGE_SLOTS], excess_total = 0.0;
+    double median[STAGE_SLOTS], tail_avg[STAGE_SLOTS];
+
+    for ( uint32_t s = 0; s < STAGE_SLOTS; s++ ) {
+        uint64_t sum = 0;
+        for ( uint32_t i = 0; i < n; i++ )
+            column[i] = done[i]->stage_ns[s];
+        for ( uint32_t i = tail; i < n; i++ )
+            sum += done[i]->stage_ns[s];
+        qsort(column, n, sizeof(uint64_t), u64_cmp);
+
+        median[s] = (double)column[n/2];
+        tail_avg[s] = (double)sum / slow;
+        excess[s] = tail_avg[s] - median[s];
+        if ( excess[s] > 0.0 )
+            excess_total += excess[s];
+    }
+
+    int32_t worst = -1;
+    char buf[32];
+    for ( uint32_t s = 0; s < STAGE_SLOTS; s++ ) {
+        if ( !median[s] && !tail_avg[s] )
+            continue;
+        double share = (excess[s] > 0.0 && excess_total > 0.0) ? excess[s]/excess_total*100.0 : 0.0;
+        printf(" %-16s │ %-10.1f │ %-11.1f │ %-10.1f │ %5.1f%%\n"
+               ,request_stage_label(s, buf, sizeof(buf))
+               ,median[s]/1e3, tail_avg[s]/1e3, excess[s]/1e3, share);
+        if ( worst < 0 || excess[s] > excess[worst] )
+            worst = (int32_t)s;
+    }
+    printf("──────────────────┴────────────┴─────────────┴────────────┴────────\n");
+    if ( worst >= 0 )
+        printf(" tail latency dominated by: %s\n", request_stage_label((uint32_t)worst, buf, sizeof(buf)));
+
+out:
+    free(done);
+    free(column);
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "../inc/timekeeper.h"
+
+#define SIMD_CHECKS 8           /* randomized inputs compared per variant */
+
+static const char * simd_feature_names[] = { "sse4.2", "avx2", "avx512f" };
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t simd_xgetbv()
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+/* cpuid, plus xgetbv to check the os saves the wider registers */
+uint32_t timekeeper_cpu_features()
+{
+    uint32_t features = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+
+    if ( !__get_cpuid(1, &eax, &ebx, &ecx, &edx) )
+        return 0;
+    if ( ecx & bit_SSE4_2 )
+        features |= TK_SIMD_SSE42;
+
+    int osxsave = (ecx & bit_OSXSAVE) && (ecx & bit_AVX);
+    uint64_t xcr0 = osxsave ? simd_xgetbv() : 0;
+
+    if ( !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) )
+        return features;
+    if ( (xcr0 & 0x6) == 0x6 && (ebx & bit_AVX2) )
+        features |= TK_SIMD_AVX2;
+    if ( (xcr0 & 0xe6) == 0xe6 && (ebx & bit_AVX512F) )
+        features |= TK_SIMD_AVX512;
+#endif
+    return features;
+}
+
+int timekeeper_kernel_add(Timekeeper_Kernel * kernel, const char * name,
+                          Void_Funct_Kernel funct, uint32_t features)
+{
+    if ( kernel->count == TK_SIMD_VARIANTS )
+        return -1;
+
+    Timekeeper_Variant * variant = &kernel->variants[kernel->count++];
+    variant->name = name;
+    variant->funct = funct;
+    variant->features = features;
+    variant->ns = 0.0;
+    variant->status = TK_VARIANT_UNTESTED;
+    return 0;
+}
+
+static void simd_fill(void * in, size_t bytes, uint64_t seed)
+{
+    uint8_t * cursor = in;
+    for ( size_t i = 0; i < bytes; i++ ) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        cursor[i] = (uint8_t)seed;
+    }
+}
+
+/* checks every supported variant against the first supported one on
+ * randomized inputs of odd and even lengths, then times the ones that
+ * agree on n elements. best is set to the fastest */
+Void_Funct_Kernel timekeeper_kernel_rank(Timekeeper_Kernel * kernel, size_t n, uint32_t rounds)
+{
+    uint32_t features = timekeeper_cpu_features();
+    Timekeeper_Variant * reference = NULL;
+
+    uint8_t * in = malloc(n * kernel->in_size + 64);
+    uint8_t * expect = malloc(n * kernel->out_size + 64);
+    uint8_t * got = malloc(n * kernel->out_size + 64);
+    if ( !in || !expect || !got || !n )
+        goto out;
+
+    for ( uint32_t v = 0; v < kernel->count; v++ ) {
+        Timekeeper_Variant * variant = &kernel->variants[v];
+        if ( (variant->features & features) != variant->features )
+            variant->status = TK_VARIANT_UNSUPPORTED;
+        else if ( !reference )
+            reference = variant;
+        else
+            variant->status = TK_VARIANT_UNTESTED;
+    }
+    if ( !reference )
+        goto out;
+    reference->status = TK_VARIANT_OK;
+
+    for ( uint32_t c = 0; c < SIMD_CHECKS; c++ ) {
+        /* lengths n, n-1, ... exercise the scalar tails */
+        size_t len = n > c ? n - c : 1;
+        uint64_t seed = 0x9e3779b97f4a7c15ull * (c + 1);
+
+        if ( kernel->fill )
+            kernel->fill(in, len, seed);
+        else
+            simd_fill(in, len * kernel->in_size, seed);
+        memset(expect, 0, len * kernel->out_size);
+        reference->funct(expect, in, len);
+
+        for ( uint32_t v = 0; v < kernel->count; v++ ) {
+            Timekeeper_Variant * variant = &kernel->variants[v];
+            if ( variant == reference || variant->status == TK_VARIANT_UNSUPPORTED
+                 || variant->status == TK_VARIANT_MISMATCH )
+                continue;
+
+            memset(got, 0, len * kernel->out_size);
+            variant->funct(got, in, len);
+            variant->status = memcmp(expect, got, len * kernel->out_size)
+                              ? TK_VARIANT_MISMATCH : TK_VARIANT_OK;
+        }
+    }
+
+    kernel->best = NULL;
+    double best_ns = 0.0;
+    for ( uint32_t v = 0; v < kernel->count; v++ ) {
+        Timekeeper_Variant * variant = &kernel->variants[v];
+        if ( variant->status != TK_VARIANT_OK )
+            continue;
+
+        variant->ns = 0.0;
+        variant->funct(got, in, n);
+        for ( uint32_t r = 0; r < (rounds ? rounds : 1); r++ ) {
+            uint64_t start = timekeeper_now_ns();
+            variant->funct(got, in, n);
+            double ns = (double)(timekeeper_now_ns() - start);
+            if ( !variant->ns || ns < variant->ns )
+                variant->ns = ns;
+        }
+        if ( !kernel->best || variant->ns < best_ns ) {
+            kernel->best = variant->funct;
+            kernel->best_index = v;
+            best_ns = variant->ns;
+        }
+    }
+
+    if ( kernel->best && kernel->name ) {
+        Timekeeper_Param param = { "variant", NULL, 0 };
+        int64_t index = kernel->best_index;
+        timekeeper_tune_store(kernel->name, &param, 1, &index);
+    }
+
+out:
+    free(in);
+    free(expect);
+    free(got);
+    return kernel->best;
+}
+
+/* startup dispatch: the variant ranked fastest on this host when it is
+ * still supported, otherwise the last supported one registered */
+Void_Funct_Kernel timekeeper_kernel_dispatch(Timekeeper_Kernel * kernel)
+{
+    uint32_t features = timekeeper_cpu_features();
+    int64_t index;
+
+    kernel->best = NULL;
+    if ( kernel->name && !timekeeper_tune_load(kernel->name, &index, 1)
+         && index >= 0 && (uint64_t)index < kernel->count
+         && (kernel->variants[index].features & features) == kernel->variants[index].features ) {
+        kernel->best_index = (uint32_t)index;
+        kernel->best = kernel->variants[index].funct;
+        return kernel->best;
+    }
+
+    for ( uint32_t v = 0; v < kernel->count; v++ ) {
+        if ( (kernel->variants[v].features & features) == kernel->variants[v].features ) {
+            kernel->best_index = v;
+            kernel->best = kernel->variants[v].funct;
+        }
+    }
+    return kernel->best;
+}
+
+void timekeeper_kernel_print(const Timekeeper_Kernel * kernel, size_t n)
+{
+    static const char * status_names[] = { "untested", "ok", "unsupported", "MISMATCH" };
+    double base = 0.0;
+
+    printf(" %s (%zu elements)\n", kernel->name ? kernel->name : "kernel", n);
+    printf(" variant          │ needs                │ status      │ ns/elem    │ speedup\n");
+    printf("──────────────────┼──────────────────────┼─────────────┼────────────┼─────────\n");
+    for ( uint32_t v = 0; v < kernel->count; v++ ) {
+        const Timekeeper_Variant * variant = &kernel->variants[v];
+        char needs[64] = "-";
+        int len = 0;
+
+        for ( uint32_t f = 0; f < 3; f++ )
+            if ( variant->features & (1u << f) )
+                len += snprintf(needs + len, sizeof(needs) - len, "%s%s", len ? "," : "", simd_feature_names[f]);
+
+        if ( variant->status != TK_VARIANT_OK ) {
+            printf(" %-16s │ %-20s │ %-11s │\n", variant->name, needs, status_names[variant->status]);
+            continue;
+        }
+        if ( !base )
+            base = variant->ns;
+        printf(" %-16s │ %-20s │ %-11s │ %-10.3f │ %6.2fx%s\n", variant->name, needs
+               ,status_names[variant->status], variant->ns / n, base / variant->ns
+               ,kernel->best == variant->funct ? " *" : "");
+    }
+    printf("──────────────────┴──────────────────────┴─────────────┴────────────┴─────────\n");
+}
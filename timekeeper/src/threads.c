@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../inc/timekeeper.h"
+
+typedef struct {
+    int tid;
+    char name[16];
+    uint64_t first_ns;          /* cpu time at the first sample */
+    uint64_t last_ns;
+    uint64_t running;           /* samples in state R */
+    uint64_t waiting;           /* samples in S or D */
+    char timeline[TK_THREAD_SAMPLES];
+} Thread_Track;
+
+static struct {
+    pthread_t sampler;
+    int running;
+    int self_tid;
+    long hz;
+    uint64_t interval_ns;
+    uint32_t samples;
+    uint64_t start_ns;
+    uint64_t stop_ns;
+    uint32_t count;
+    Thread_Track threads[TK_THREAD_MAX];
+} track;
+
+static Thread_Track * threads_find(int tid)
+{
+    for ( uint32_t i = 0; i < track.count; i++ )
+        if ( track.threads[i].tid == tid )
+            return &track.threads[i];
+
+    if ( track.count == TK_THREAD_MAX )
+        return NULL;
+
+    Thread_Track * thread = &track.threads[track.count++];
+    memset(thread, 0, sizeof(*thread));
+    memset(thread->timeline, ' ', sizeof(thread->timeline));
+    thread->tid = tid;
+    return thread;
+}
+
+/* cpu time of tid in ns, the first field of /proc/self/task/<tid>/schedstat.
+ * falls back to utime + stime from stat, which only moves in USER_HZ ticks */
+static uint64_t threads_cpu_ns(int tid, unsigned long long ticks)
+{
+    char path[64];
+    unsigned long long ns;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+    FILE * schedstat = fopen(path, "r");
+    if ( schedstat ) {
+        int got = fscanf(schedstat, "%llu", &ns);
+        fclose(schedstat);
+        if ( got == 1 )
+            return ns;
+    }
+    return ticks * 1000000000ull / (unsigned long long)track.hz;
+}
+
+/* /proc/self/task/<tid>/stat: "tid (comm) state ... utime(14) stime(15)" */
+static void threads_sample(uint32_t slot)
+{
+    DIR * dir = opendir("/proc/self/task");
+    struct dirent * entry;
+    char path[64], line[1024];
+
+    if ( !dir )
+        return;
+
+    while ( (entry = readdir(dir)) ) {
+        int tid = atoi(entry->d_name);
+        if ( tid <= 0 || tid == track.self_tid )
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+        FILE * stat = fopen(path, "r");
+        if ( !stat )
+            continue;
+        size_t got = fread(line, 1, sizeof(line) - 1, stat);
+        fclose(stat);
+        line[got] = '\0';
+
+        char * open = strchr(line, '('), * close = strrchr(line, ')');
+        if ( !open || !close )
+            continue;
+
+        char state;
+        unsigned long long utime, stime;
+        if ( sscanf(close + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                    &state, &utime, &stime) != 3 )
+            continue;
+
+        Thread_Track * thread = threads_find(tid);
+        if ( !thread )
+            continue;
+
+        uint64_t cpu_ns = threads_cpu_ns(tid, utime + stime);
+        if ( !thread->first_ns && !thread->last_ns ) {
+            size_t len = (size_t)(close - open - 1);
+            if ( len > sizeof(thread->name) - 1 )
+                len = sizeof(thread->name) - 1;
+            memcpy(thread->name, open + 1, len);
+            thread->name[len] = '\0';
+            thread->first_ns = cpu_ns;
+        }
+        thread->last_ns = cpu_ns;
+
+        if ( state == 'R' )
+            thread->running++;
+        else if ( state == 'S' || state == 'D' )
+            thread->waiting++;
+        if ( slot < TK_THREAD_SAMPLES )
+            thread->timeline[slot] = state;
+    }
+    closedir(dir);
+}
+
+static void * threads_loop(void * arg)
+{
+    (void)arg;
+    track.self_tid = gettid();
+
+    uint64_t next = timekeeper_now_ns();
+    while ( __atomic_load_n(&track.running, __ATOMIC_ACQUIRE) ) {
+        threads_sample(track.samples++);
+
+        next += track.interval_ns;
+        uint64_t now = timekeeper_now_ns();
+        if ( next > now ) {
+            struct timespec wait = { (time_t)((next - now) / 1000000000ull), (long)((next - now) % 1000000000ull) };
+            nanosleep(&wait, NULL);
+        }
+    }
+    return NULL;
+}
+
+int timekeeper_threads_start(uint64_t interval_ns)
+{
+    if ( track.running )
+        return -1;
+
+    memset(&track, 0, sizeof(track));
+    track.interval_ns = interval_ns ? interval_ns : 1000000;
+    track.running = 1;
+    track.hz = sysconf(_SC_CLK_TCK);
+    track.start_ns = timekeeper_now_ns();
+
+    if ( pthread_create(&track.sampler, NULL, threads_loop, NULL) ) {
+        track.running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void timekeeper_threads_stop()
+{
+    if ( !track.running )
+        return;
+
+    __atomic_store_n(&track.running, 0, __ATOMIC_RELEASE);
+    pthread_join(track.sampler, NULL);
+    track.stop_ns = timekeeper_now_ns();
+}
+
+/* per thread cpu time and state shares, the timeline (one column per
+ * sample, squeezed to width characters), the load imbalance (max / mean
+ * cpu time - 1) and how long the busiest thread spent waiting */
+void timekeeper_threads_print(uint32_t width)
+{
+    double wall = (double)(track.stop_ns - track.start_ns) / 1e9;
+    uint32_t samples = track.samples < TK_THREAD_SAMPLES ? track.samples : TK_THREAD_SAMPLES;
+    uint32_t step = width && samples > width ? (samples + width - 1) / width : 1;
+
+    printf(" wall %.3f s │ %u samples every %.2f ms │ R running, S/D waiting\n"
+           ,wall, track.samples, (double)track.interval_ns/1e6);
+    printf(" tid      │ name             │ cpu(ms)    │ run%%   │ wait%%  │ timeline\n");
+    printf("──────────┼──────────────────┼────────────┼────────┼────────┼──────────\n");
+
+    double total = 0.0, max = 0.0;
+    Thread_Track * critical = NULL;
+    uint32_t active = 0;
+
+    for ( uint32_t i = 0; i < track.count; i++ ) {
+        Thread_Track * thread = &track.threads[i];
+        double cpu = (double)(thread->last_ns - thread->first_ns) / 1e6;
+        uint64_t seen = thread->running + thread->waiting;
+        seen = seen ? seen : 1;
+
+        printf(" %-8d │ %-16s │ %-10.1f │ %5.1f%% │ %5.1f%% │ ", thread->tid, thread->name, cpu
+               ,(double)thread->running*100.0/seen, (double)thread->waiting*100.0/seen);
+        for ( uint32_t s = 0; s < samples; s += step )
+            putchar(thread->timeline[s]);
+        putchar('\n');
+
+        total += cpu;
+        if ( cpu > 0.0 )
+            active++;
+        if ( !critical || cpu > max ) {
+            max = cpu;
+            critical = thread;
+        }
+    }
+    printf("──────────┴──────────────────┴────────────┴────────┴────────┴──────────\n");
+
+    if ( !critical || !active )
+        return;
+
+    uint64_t seen = critical->running + critical->waiting;
+    printf(" load imbalance: %.2f │ critical thread %d waited %.1f%% of the run\n"
+           ,max / (total / active) - 1.0, critical->tid
+           ,seen ? (double)critical->waiting*100.0/seen : 0.0);
+}
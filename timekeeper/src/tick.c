@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/timekeeper.h"
+
+#define TICK_ZONES      64      /* zones followed per tick */
+#define TICK_TOP        4       /* zones kept per slow tick */
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    Timekeeper_Zone * zones[TICK_TOP];
+    uint64_t zone_ns[TICK_TOP];
+} Tick_Slow;
+
+typedef struct {
+    uint64_t budget_ns;
+    uint64_t start_ns;
+    uint64_t prev_start_ns;
+    uint64_t count;
+    uint64_t over;
+    uint64_t duration_hist[TK_HIST_BUCKETS];
+    uint64_t lag_hist[TK_HIST_BUCKETS];
+    uint64_t max_ns;
+
+    /* zone totals at tick_begin, looked up by zone at tick_end */
+    Timekeeper_Zone * mark_zones[TICK_ZONES];
+    uint64_t mark_ns[TICK_ZONES];
+    uint32_t mark_count;
+
+    /* time in each zone during slow ticks */
+    Timekeeper_Zone * zones[TICK_ZONES];
+    uint64_t zone_over_ns[TICK_ZONES];
+    uint32_t zone_count;
+
+    Tick_Slow slow[TK_TICK_SLOW];
+    uint64_t slow_next;
+} Tick_Loop;
+
+/* one loop per thread */
+static _Thread_local Tick_Loop loop;
+
+void timekeeper_tick_budget(uint64_t budget_ns)
+{
+    loop.budget_ns = budget_ns;
+}
+
+void timekeeper_tick_begin()
+{
+    Timekeeper_Zone * zone;
+    uint32_t i = 0;
+
+    for ( zone = __atomic_load_n(&timekeeper_zones, __ATOMIC_ACQUIRE);
+          zone && i < TICK_ZONES; zone = zone->next, i++ ) {
+        loop.mark_zones[i] = zone;
+        loop.mark_ns[i] = zone->total_ns;
+    }
+    loop.mark_count = i;
+
+    loop.start_ns = timekeeper_now_ns();
+    if ( loop.prev_start_ns )
+        loop.lag_hist[timekeeper_hist_bucket(loop.start_ns - loop.prev_start_ns)]++;
+    loop.prev_start_ns = loop.start_ns;
+}
+
+/* a zone missing from the tick_begin marks was registered by its first
+ * commit during this tick, so all of its time belongs to the tick */
+static uint64_t tick_mark(const Timekeeper_Zone * zone)
+{
+    for ( uint32_t i = 0; i < loop.mark_count; i++ )
+        if ( loop.mark_zones[i] == zone )
+            return loop.mark_ns[i];
+    return 0;
+}
+
+static void tick_charge(Timekeeper_Zone * zone, uint64_t spent)
+{
+    uint32_t i;
+    for ( i = 0; i < loop.zone_count; i++ )
+        if ( loop.zones[i] == zone )
+            break;
+    if ( i == loop.zone_count ) {
+        if ( loop.zone_count == TICK_ZONES )
+            return;
+        loop.zones[loop.zone_count++] = zone;
+    }
+    loop.zone_over_ns[i] += spent;
+}
+
+void timekeeper_tick_end()
+{
+    uint64_t ns = timekeeper_now_ns() - loop.start_ns;
+
+    loop.count++;
+    loop.duration_hist[timekeeper_hist_bucket(ns)]++;
+    if ( ns > loop.max_ns )
+        loop.max_ns = ns;
+
+    if ( !loop.budget_ns || ns <= loop.budget_ns )
+        return;
+
+    loop.over++;
+    Tick_Slow * slow = &loop.slow[loop.slow_next++ % TK_TICK_SLOW];
+    memset(slow, 0, sizeof(*slow));
+    slow->start_ns = loop.start_ns;
+    slow->duration_ns = ns;
+
+    Timekeeper_Zone * zone = __atomic_load_n(&timekeeper_zones, __ATOMIC_ACQUIRE);
+    for ( uint32_t i = 0; zone && i < TICK_ZONES; zone = zone->next, i++ ) {
+        uint64_t spent = zone->total_ns - tick_mark(zone);
+        if ( !spent )
+            continue;
+        tick_charge(zone, spent);
+
+        /* insertion into the top list, largest first */
+        for ( uint32_t t = 0; t < TICK_TOP; t++ ) {
+            if ( spent <= slow->zone_ns[t] )
+                continue;
+            memmove(&slow->zones[t + 1], &slow->zones[t], (TICK_TOP - t - 1)*sizeof(slow->zones[0]));
+            memmove(&slow->zone_ns[t + 1], &slow->zone_ns[t], (TICK_TOP - t - 1)*sizeof(slow->zone_ns[0]));
+            slow->zones[t] = zone;
+            slow->zone_ns[t] = spent;
+            break;
+        }
+    }
+}
+
+static void tick_print_hist(const char * label, const uint64_t * hist)
+{
+    printf(" %-10s │ p50 %-10.1f │ p90 %-10.1f │ p99 %-10.1f │ p99.9 %-10.1f (us)\n", label
+           ,(double)timekeeper_hist_percentile(hist, 0.50)/1e3
+           ,(double)timekeeper_hist_percentile(hist, 0.90)/1e3
+           ,(double)timekeeper_hist_percentile(hist, 0.99)/1e3
+           ,(double)timekeeper_hist_percentile(hist, 0.999)/1e3);
+}
+
+/* reports the calling thread's loop */
+void timekeeper_tick_print()
+{
+    printf(" ticks: %llu │ over budget: %llu │ max %.1f us\n"
+           ,(unsigned long long)loop.count, (unsigned long long)loop.over
+           ,(double)loop.max_ns/1e3);
+    tick_print_hist("duration", loop.duration_hist);
+    tick_print_hist("loop lag", loop.lag_hist);
+
+    if ( !loop.over )
+        return;
+
+    printf(" zone             │ in slow ticks(ms)\n");
+    printf("──────────────────┼───────────────────\n");
+    for ( uint32_t i = 0; i < loop.zone_count; i++ )
+        if ( loop.zone_over_ns[i] )
+            printf(" %-16s │ %-10.3f\n", loop.zones[i]->name, (double)loop.zone_over_ns[i]/1e6);
+    printf("──────────────────┴───────────────────\n");
+
+    uint64_t first = loop.slow_next > TK_TICK_SLOW ? loop.slow_next - TK_TICK_SLOW : 0;
+    for ( uint64_t s = first; s < loop.slow_next; s++ ) {
+        Tick_Slow * slow = &loop.slow[s % TK_TICK_SLOW];
+        printf(" slow tick +%.3f ms: %.1f us │", (double)(slow->start_ns - loop.slow[first % TK_TICK_SLOW].start_ns)/1e6
+               ,(double)slow->duration_ns/1e3);
+        for ( uint32_t t = 0; t < TICK_TOP && slow->zones[t]; t++ )
+            printf(" %s %.1f us", slow->zones[t]->name, (double)slow->zone_ns[t]/1e3);
+        printf("\n");
+    }
+}
@@ -1,6 +1,7 @@
 
 #include <time.h>
 
+#define TIMEKEEPER_IMPLEMENTATION
 #include "../inc/timekeeper.h"
 
 // typedef return   (*FuncTypeName)(take);
@@ -18,3 +19,22 @@ double timekeeper_benchmark_funct(Void_Funct_Void funct)
 
     return endTime - startTime;
 }
+
+/* upper bound of the log2 bucket holding the p-th fraction of the samples */
+uint64_t timekeeper_hist_percentile(const uint64_t * hist, double p)
+{
+    uint64_t total = 0, seen = 0;
+
+    for ( uint32_t b = 0; b < TK_HIST_BUCKETS; b++ )
+        total += hist[b];
+    if ( !total )
+        return 0;
+
+    uint64_t rank = (uint64_t)(p * (double)total);
+    for ( uint32_t b = 0; b < TK_HIST_BUCKETS; b++ ) {
+        seen += hist[b];
+        if ( seen > rank )
+            return b ? 1ull << b : 0;
+    }
+    return 1ull << (TK_HIST_BUCKETS - 1);
+}
@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../inc/timekeeper.h"
+
+#define TUNE_EXHAUSTIVE 64      /* spaces up to this size are fully searched */
+#define TUNE_SAMPLES    256     /* candidates drawn from bigger spaces */
+#define TUNE_REPEATS    5       /* measurements per candidate (first round) */
+#define TUNE_LINE       1024
+
+typedef struct {
+    uint64_t index;
+    double score;
+} Tune_Candidate;
+
+static void tune_decode(uint64_t index, const Timekeeper_Param * params,
+                        uint32_t param_count, int64_t * config)
+{
+    for ( uint32_t i = 0; i < param_count; i++ ) {
+        config[i] = params[i].values[index % params[i].len];
+        index /= params[i].len;
+    }
+}
+
+/* best (min) of reps runs, one warmup run discarded */
+static double tune_measure(Void_Funct_Config funct, void * arg,
+                           const int64_t * config, uint32_t reps)
+{
+    double best = -1.0;
+
+    funct(config, arg);
+    for ( uint32_t r = 0; r < reps; r++ ) {
+        uint64_t start = timekeeper_now_ns();
+        funct(config, arg);
+        double elapsed = (double)(timekeeper_now_ns() - start);
+        if ( best < 0.0 || elapsed < best )
+            best = elapsed;
+    }
+    return best;
+}
+
+static int tune_cmp(const void * a, const void * b)
+{
+    double sa = ((const Tune_Candidate *)a)->score;
+    double sb = ((const Tune_Candidate *)b)->score;
+    return (sa > sb) - (sa < sb);
+}
+
+static int tune_path(char * buf, size_t len)
+{
+    const char * env = getenv("TIMEKEEPER_TUNE_CACHE");
+    if ( env && *env ) {
+        snprintf(buf, len, "%s", env);
+        return 0;
+    }
+
+    const char * home = getenv("HOME");
+    char host[256];
+    if ( !home || gethostname(host, sizeof(host)) )
+        return -1;
+    host[sizeof(host) - 1] = '\0';
+
+    snprintf(buf, len, "%s/.cache", home);
+    mkdir(buf, 0755);
+    snprintf(buf, len, "%s/.cache/timekeeper", home);
+    mkdir(buf, 0755);
+    snprintf(buf, len, "%s/.cache/timekeeper/%s.tune", home, host);
+    return 0;
+}
+
+/* rewrite the cache, replacing the line of name */
+int timekeeper_tune_store(const char * name, const Timekeeper_Param * params,
+                          uint32_t param_count, const int64_t * config)
+{
+    char path[512], tmp_path[520], line[TUNE_LINE];
+    size_t name_len = strlen(name);
+
+    if ( tune_path(path, sizeof(path)) )
+        return -1;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE * out = fopen(tmp_path, "w");
+    if ( !out )
+        return -1;
+
+    FILE * in = fopen(path, "r");
+    if ( in ) {
+        while ( fgets(line, sizeof(line), in) ) {
+            if ( !strncmp(line, name, name_len) && line[name_len] == ' ' )
+                continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+
+    fprintf(out, "%s", name);
+    for ( uint32_t i = 0; i < param_count; i++ )
+        fprintf(out, " %s=%lld", params[i].name, (long long)config[i]);
+    fprintf(out, "\n");
+
+    if ( fclose(out) )
+        return -1;
+    return rename(tmp_path, path);
+}
+
+int timekeeper_tune(const char * name, Void_Funct_Config funct, void * arg,
+                    const Timekeeper_Param * params, uint32_t param_count,
+                    int64_t * best_config)
+{
+    uint64_t space = 1;
+    int huge = 0;
+
+    if ( !name || !funct || !params || !param_count || !best_config )
+        return -1;
+
+    for ( uint32_t i = 0; i < param_count; i++ ) {
+        if ( !params[i].len )
+            return -1;
+        if ( space > UINT64_MAX / params[i].len )
+            huge = 1;
+        else
+            space *= params[i].len;
+    }
+
+    uint32_t count = (!huge && space <= TUNE_SAMPLES) ? (uint32_t)space : TUNE_SAMPLES;
+    Tune_Candidate * cand = malloc(count * sizeof(Tune_Candidate));
+    int64_t * config = malloc(param_count * sizeof(int64_t));
+    if ( !cand || !config ) {
+        free(cand);
+        free(config);
+        return -1;
+    }
+
+    if ( count == space ) {
+        for ( uint32_t i = 0; i < count; i++ )
+            cand[i].index = i;
+    } else {
+        /* xorshift sample of the space, duplicates are harmless */
+        uint64_t seed = timekeeper_now_ns() | 1;
+        for ( uint32_t i = 0; i < count; i++ ) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            cand[i].index = huge ? seed : seed % space;
+        }
+    }
+
+    uint32_t alive = count;
+    uint32_t reps = TUNE_REPEATS;
+
+    if ( count <= TUNE_EXHAUSTIVE ) {
+        for ( uint32_t i = 0; i < count; i++ ) {
+            tune_decode(cand[i].index, params, param_count, config);
+            cand[i].score = tune_measure(funct, arg, config, reps);
+        }
+        qsort(cand, count, sizeof(Tune_Candidate), tune_cmp);
+    } else {
+        /* successive halving: keep the best half, double the repeats */
+        while ( alive > 1 ) {
+            for ( uint32_t i = 0; i < alive; i++ ) {
+                tune_decode(cand[i].index, params, param_count, config);
+                cand[i].score = tune_measure(funct, arg, config, reps);
+            }
+            qsort(cand, alive, sizeof(Tune_Candidate), tune_cmp);
+            alive = (alive + 1) / 2;
+            reps *= 2;
+        }
+    }
+
+    tune_decode(cand[0].index, params, param_count, best_config);
+    free(cand);
+    free(config);
+
+    return timekeeper_tune_store(name, params, param_count, best_config);
+}
+
+int timekeeper_tune_load(const char * name, int64_t * config, uint32_t param_count)
+{
+    char path[512], line[TUNE_LINE];
+    size_t name_len = strlen(name);
+    int found = -1;
+
+    if ( tune_path(path, sizeof(path)) )
+        return -1;
+
+    FILE * in = fopen(path, "r");
+    if ( !in )
+        return -1;
+
+    while ( found && fgets(line, sizeof(line), in) ) {
+        if ( strncmp(line, name, name_len) || line[name_len] != ' ' )
+            continue;
+
+        char * cursor = line + name_len;
+        uint32_t i;
+        for ( i = 0; i < param_count; i++ ) {
+            cursor = strchr(cursor, '=');
+            if ( !cursor )
+                break;
+            config[i] = strtoll(cursor + 1, &cursor, 10);
+        }
+        found = (i == param_count) ? 0 : -1;
+    }
+
+    fclose(in);
+    return found;
+}
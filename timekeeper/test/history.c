@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../inc/timekeeper.h"
+
+/* a noiseless step has no spread between consecutive runs and must still
+ * be reported */
+
+static int failed;
+
+#define CHECK(cond) do {                                                     \
+    if ( !(cond) ) {                                                         \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+        failed = 1;                                                          \
+    }                                                                        \
+} while ( 0 )
+
+static void history_runs(const char * path, const char * bench, const double * values, int n)
+{
+    char revision[16];
+    for ( int i = 0; i < n; i++ ) {
+        snprintf(revision, sizeof(revision), "r%d", i);
+        setenv("TIMEKEEPER_REVISION", revision, 1);
+        timekeeper_history_append(path, bench, values[i]);
+    }
+}
+
+int main()
+{
+    char path[] = "/tmp/tk_history_XXXXXX";
+    int fd = mkstemp(path);
+    if ( fd < 0 )
+        return 1;
+    close(fd);
+
+    double step[20], flat[20], quantized[20];
+    for ( int i = 0; i < 20; i++ ) {
+        step[i] = i < 10 ? 1000.0 : 3000.0;
+        flat[i] = 1000.0;
+        quantized[i] = i % 4 ? 1000.0 : 1001.0;
+    }
+    history_runs(path, "step", step, 20);
+    history_runs(path, "flat", flat, 20);
+    history_runs(path, "quantized", quantized, 20);
+
+    CHECK(timekeeper_history_changes(path, "step", 1.36) == 1);
+    CHECK(timekeeper_history_changes(path, "flat", 1.36) == 0);
+    CHECK(timekeeper_history_changes(path, "quantized", 1.36) == 0);
+
+    unlink(path);
+    printf("history: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+
+/* measurement overhead of the timekeeper primitives, the numbers behind the
+ * table in README.md, built against the library by `make bench`. the clock
+ * reads, zones and TK_BENCH are static inline in timekeeper_inline.h and
+ * compile the same without the library, timekeeper_benchmark_funct is the
+ * one out-of-line call. every figure is the fastest of BATCHES batches of
+ * ITERS iterations, with the cost of an empty loop subtracted (except the
+ * TK_BENCH row, which is that loop) */
+
+#include "../inc/timekeeper.h"
+
+#define BATCHES     20
+#define ITERS       1000000
+
+static uint64_t sink;
+
+TK_ZONE(overhead_zone, "overhead");
+
+static void empty_funct()
+{
+    timekeeper_do_not_optimize(&sink);
+}
+
+static void overhead_row(const char * name, double ns)
+{
+    printf(" %-34s │ %8.2f ns\n", name, ns < 0.0 ? 0.0 : ns);
+}
+
+int main()
+{
+    double loop_ns, now_ns, zone_ns;
+
+    TK_BENCH_BATCH(loop_ns, BATCHES, ITERS, timekeeper_do_not_optimize(&sink));
+    TK_BENCH_BATCH(now_ns, BATCHES, ITERS,
+                   sink += timekeeper_now_ns(); timekeeper_do_not_optimize(&sink));
+    TK_BENCH_BATCH(zone_ns, BATCHES, ITERS,
+                   TK_ZONE_BEGIN(overhead_zone)
+                   timekeeper_do_not_optimize(&sink);
+                   TK_ZONE_END(overhead_zone));
+
+    printf(" %d x %d iterations\n", BATCHES, ITERS);
+    printf(" primitive                          │ cost\n");
+    printf("────────────────────────────────────┼────────────\n");
+    overhead_row("timekeeper_now_ns", now_ns - loop_ns);
+    overhead_row("TK_ZONE_BEGIN / TK_ZONE_END", zone_ns - loop_ns);
+    overhead_row("TK_BENCH per iteration", loop_ns);
+    double funct_ns;
+    TK_BENCH_BATCH(funct_ns, BATCHES, ITERS/10, timekeeper_benchmark_funct(empty_funct));
+    overhead_row("timekeeper_benchmark_funct", funct_ns - loop_ns);
+    printf("────────────────────────────────────┴────────────\n");
+
+    return 0;
+}